@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <stdexcept>
+
+namespace pp
+{
+	//-------------------------------------------------------------------------------------------------------
+	// Outcome of dispatching an intent with a latency budget.
+	enum class eDispatchStatus
+	{
+		SUCCESS,
+		NO_HANDLER,
+		// none of the handlers finished within the budget
+		TIMEOUT,
+		// all of the handlers signaled overload with HandlerOverloaded
+		OVERLOADED
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Result of Router::processIntentWithin.
+	// @tparam R - result type of the dispatched intent
+	template <typename R>
+	class DispatchResult
+	{
+	public:
+		eDispatchStatus status = eDispatchStatus::NO_HANDLER;
+		// set only if status is SUCCESS
+		std::optional<R> value;
+		// index of the handler that produced the value, -1 otherwise
+		int handlerIndex = -1;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Intent handlers may throw this exception to signal that they
+	// can't process the intent right now. Router::processIntentWithin
+	// falls back to the next eligible handler then.
+	class HandlerOverloaded : public std::runtime_error
+	{
+	public:
+		HandlerOverloaded() : std::runtime_error("Intent handler is overloaded") {}
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Recent latency of a single intent handler, kept as an
+	// exponentially weighted moving average. Updates from concurrent
+	// calls may occasionally be lost which is fine for an estimate.
+	// The first call is usually much slower (page faults, cold 
+	// caches, lazy initialization) so it's kept aside and the average
+	// starts over with the second call.
+	class HandlerLatency
+	{
+	public:
+		// Adds a new sample to the average.
+		// @param latency - duration of the handler call
+		void record(std::chrono::nanoseconds latency)
+		{
+			const std::int64_t sample = latency.count();
+			const std::size_t index = m_callsCount.fetch_add(1, std::memory_order_relaxed);
+			if (index == 0)
+				m_firstCallNs.store(sample, std::memory_order_relaxed);
+
+			const std::int64_t average = m_averageNs.load(std::memory_order_relaxed);
+			m_averageNs.store(average < 0 || index == 1 ? sample : average + (sample - average) / 8, std::memory_order_relaxed);
+		}
+
+		// @returns average latency or negative value if the handler
+		//		wasn't called yet
+		std::chrono::nanoseconds getAverage() const { return std::chrono::nanoseconds(m_averageNs.load(std::memory_order_relaxed)); }
+
+		// @returns latency of the first call or negative value if the
+		//		handler wasn't called yet
+		std::chrono::nanoseconds getFirstCall() const { return std::chrono::nanoseconds(m_firstCallNs.load(std::memory_order_relaxed)); }
+
+		// @returns number of recorded calls
+		std::size_t getCallsCount() const { return m_callsCount.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<std::int64_t> m_averageNs = -1;
+		std::atomic<std::int64_t> m_firstCallNs = -1;
+		std::atomic<std::size_t> m_callsCount = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Latency of a single intent handler, see Router::getLatencyReport.
+	class HandlerLatencyReport
+	{
+	public:
+		std::string intentName;
+		std::string pluginName;
+		// latency of the first call, negative if it wasn't called yet
+		std::chrono::nanoseconds firstCall{ -1 };
+		// recent average excluding the first call, negative if it 
+		// was called at most once
+		std::chrono::nanoseconds steadyState{ -1 };
+		std::size_t callsCount = 0;
+	};
+
+} // namespace pp
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <unordered_map>
+
+#include <pp/Info.hpp>
+
+namespace pp
+{
+	class Router;
+
+	//-------------------------------------------------------------------------------------------------------
+	// Event types opt into coalescing by providing a static function
+	// returning a hashable key:
+	//		static KeyType coalescingKey(const EventType& event);
+	// Posted events with equal keys are collapsed into one delivery
+	// within a dispatch window.
+	template <typename T, typename = void>
+	struct IsCoalescable : std::false_type {};
+
+	template <typename T>
+	struct IsCoalescable<T, std::void_t<decltype(T::coalescingKey(std::declval<const T&>()))>> : std::true_type {};
+
+	//-------------------------------------------------------------------------------------------------------
+	// Coalescable events may also provide custom merge policy:
+	//		static void coalesce(EventType& pending, EventType&& incoming);
+	// Otherwise the latest posted event replaces the pending one.
+	template <typename T, typename = void>
+	struct HasCoalesce : std::false_type {};
+
+	template <typename T>
+	struct HasCoalesce<T, std::void_t<decltype(T::coalesce(std::declval<T&>(), std::declval<T&&>()))>> : std::true_type {};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Counters of posted events of one type. Deliveries are calls of
+	// event receivers.
+	class CoalescingStats
+	{
+	public:
+		std::size_t postedCount = 0;
+		// events merged into an already pending event
+		std::size_t coalescedCount = 0;
+		std::size_t dispatchedCount = 0;
+		std::size_t deliveriesCount = 0;
+		// receiver calls that would have been made without coalescing
+		std::size_t savedDeliveriesCount = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// This is the base class for queues of posted events.
+	class PostedEventsBase
+	{
+	public:
+		virtual ~PostedEventsBase() = default;
+
+		// @returns event info of events stored in this queue
+		virtual const EventInfo& getEventInfo() const = 0;
+
+		// Dispatches all queued events through the given router.
+		// @param router - router used to dispatch the events
+		// @param stats - dispatched and saved deliveries are added here
+		virtual void dispatch(Router& router, CoalescingStats& stats) = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Events of the specific type posted within one dispatch window,
+	// in order of posting. Coalescable events with the same key are
+	// kept at the position of the first one.
+	// @tparam T - type of stored events
+	template <typename T>
+	class PostedEvents final : public PostedEventsBase
+	{
+	public:
+		const EventInfo& getEventInfo() const final { return T::Info; }
+
+		// @returns true if the event was merged into a pending one
+		// @param event - posted event
+		bool push(T event);
+
+		void dispatch(Router& router, CoalescingStats& stats) final;
+
+	private:
+		template <typename U, bool = IsCoalescable<U>::value>
+		struct KeyIndices { };
+
+		template <typename U>
+		struct KeyIndices<U, true>
+		{
+			std::unordered_map<std::decay_t<decltype(U::coalescingKey(std::declval<const U&>()))>, std::size_t> indices;
+		};
+
+		std::vector<T> m_events;
+		// number of events merged into the event with matching index
+		std::vector<std::size_t> m_coalescedCounts;
+		KeyIndices<T> m_keys;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline bool PostedEvents<T>::push(T event)
+	{
+		if constexpr (IsCoalescable<T>::value)
+		{
+			const auto [it, inserted] = m_keys.indices.try_emplace(T::coalescingKey(event), m_events.size());
+			if (!inserted)
+			{
+				T& pending = m_events[it->second];
+				if constexpr (HasCoalesce<T>::value)
+					T::coalesce(pending, std::move(event));
+				else
+					pending = std::move(event);
+
+				++m_coalescedCounts[it->second];
+				return true;
+			}
+		}
+
+		m_events.push_back(std::move(event));
+		m_coalescedCounts.push_back(0);
+		return false;
+	}
+
+	// PostedEvents<T>::dispatch is defined in Router.hpp as it needs
+	// the complete Router type.
+
+} // namespace pp
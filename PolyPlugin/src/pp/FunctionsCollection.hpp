@@ -1,13 +1,50 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <algorithm>
 #include <functional>
 #include <utility>
+#include <cassert>
+#include <type_traits>
 
 #include <pp/Info.hpp>
+#include <pp/IntentCache.hpp>
+#include <pp/DeadlineDispatch.hpp>
+#include <pp/Mailbox.hpp>
+#include <pp/PluginUsage.hpp>
 
 namespace pp
 {
+	//-------------------------------------------------------------------------------------------------------
+	// Inserts the entry at given position. PluginInfo isn't assignable
+	// so entries can't be shifted by 'insert' and the vector is rebuilt
+	// instead, entries are usually appended though.
+	// @param entries - handlers or receivers of a collection
+	// @param position - index of the inserted entry
+	// @param entry - inserted entry
+	template <typename Entry>
+	inline void insertEntry(std::vector<Entry>& entries, std::size_t position, Entry entry)
+	{
+		if (position == entries.size())
+		{
+			entries.push_back(std::move(entry));
+			return;
+		}
+
+		std::vector<Entry> result;
+		result.reserve(entries.size() + 1);
+		for (std::size_t i = 0; i < entries.size(); ++i)
+		{
+			if (i == position)
+				result.push_back(std::move(entry));
+			result.push_back(entries[i]);
+		}
+		entries.swap(result);
+	}
+
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
@@ -15,6 +52,12 @@ namespace pp
 	class HandlersCollectionBase
 	{
 	public:
+		// Function creating an empty collection of the same type and 
+		// moving all handlers there. Every registration stores one so
+		// the collection can be recreated by the code of a plugin that
+		// is still loaded when the library that created it is unloaded.
+		using Relocator = std::unique_ptr<HandlersCollectionBase>(*)(HandlersCollectionBase& from);
+
 		virtual ~HandlersCollectionBase() = default;
 
 		// @returns intent info of intent that can be handled by 
@@ -26,6 +69,66 @@ namespace pp
 		//		handlers to the user before casting the collection and
 		//		accessing the handlers directly
 		virtual std::vector<PluginInfo> getPluginsInfo() const = 0;
+
+		// Removes all handlers registered by the plugin with given name.
+		// @returns number of removed handlers
+		// @param pluginName - name of the plugin
+		virtual std::size_t removePlugin(const std::string& pluginName) = 0;
+
+		// @returns results cache of the intent or nullptr if the intent
+		//		isn't cacheable
+		IntentCacheBase* getCache() const { return m_cache.get(); }
+
+		// @returns latency statistics of the handler with given index,
+		//		shared so calls that outlive the dispatch can still 
+		//		record their latency
+		const std::shared_ptr<HandlerLatency>& getLatency(int index) const { return m_states[index].latency; }
+
+		// @returns average latencies of all handlers (indices match),
+		//		negative for handlers that weren't called yet
+		std::vector<std::chrono::nanoseconds> getLatencies() const
+		{
+			std::vector<std::chrono::nanoseconds> result;
+			for (const HandlerState& state : m_states)
+				result.push_back(state.latency->getAverage());
+			return result;
+		}
+
+		// @returns usage of the plugin that registered the handler with
+		//		given index, null if usage tracking is disabled
+		const std::shared_ptr<PluginUsage>& getUsage(int index) const { return m_states[index].usage; }
+
+		// @returns new collection with all handlers of this one, created
+		//		by the code of the plugin that registered the first 
+		//		handler, this collection is left empty
+		std::unique_ptr<HandlersCollectionBase> relocate() { return m_states.front().relocator(*this); }
+
+	protected:
+		class HandlerState
+		{
+		public:
+			std::shared_ptr<HandlerLatency> latency;
+			std::shared_ptr<PluginUsage> usage;
+			// registration order, see Router::suspendPlugin
+			std::uint64_t sequence = 0;
+			Relocator relocator = nullptr;
+		};
+
+		// @returns index at which the handler with given state belongs,
+		//		handlers are sorted by their sequence
+		// @param state - state of a newly registered handler
+		std::size_t addHandlerState(HandlerState state)
+		{
+			const auto it = std::upper_bound(m_states.begin(), m_states.end(), state.sequence, 
+				[](std::uint64_t sequence, const HandlerState& other) { return sequence < other.sequence; });
+			const auto inserted = m_states.insert(it, std::move(state));
+			return inserted - m_states.begin();
+		}
+
+		std::unique_ptr<IntentCacheBase> m_cache;
+		std::size_t m_cacheCapacity = 0;
+		std::size_t m_cacheShardsCount = 0;
+		std::vector<HandlerState> m_states;
 	};
 
 	//-------------------------------------------------------------------------------------------------------
@@ -41,6 +144,35 @@ namespace pp
 		public std::vector<std::pair<PluginInfo, std::function<typename T::Result(T)>>>
 	{
 	public:
+		// @param cacheCapacity - maximal number of cached results, used
+		//		only if the intent is cacheable
+		// @param cacheShardsCount - number of cache shards
+		HandlersCollection(std::size_t cacheCapacity, std::size_t cacheShardsCount)
+		{
+			m_cacheCapacity = cacheCapacity;
+			m_cacheShardsCount = cacheShardsCount;
+			if constexpr (IsCacheable<T>::value)
+				m_cache = std::make_unique<IntentCache<T>>(cacheCapacity, cacheShardsCount);
+		}
+
+		// Registers the handler. Handlers are sorted by registration 
+		// order so handlers of a reloaded plugin get their original
+		// indices back.
+		// @param sequence - registration order of the handler
+		// @param usage - usage of the plugin, may be null
+		// @param latency - latency of the handler, created by the host
+		//		since it may outlive the plugin's library
+		void add(PluginInfo info, std::function<typename T::Result(T)> handler, std::uint64_t sequence, std::shared_ptr<PluginUsage> usage, 
+			std::shared_ptr<HandlerLatency> latency)
+		{
+			const std::size_t position = addHandlerState({ std::move(latency), std::move(usage), sequence, &HandlersCollection::relocateFrom });
+			insertEntry<typename HandlersCollection::value_type>(*this, position, { std::move(info), std::move(handler) });
+		}
+
+		// @returns results cache of the intent, valid only if the 
+		//		intent is cacheable
+		IntentCache<T>& getIntentCache() const { return *static_cast<IntentCache<T>*>(m_cache.get()); }
+
 		const IntentInfo& getIntentInfo() const final { return T::Info; }
 		std::vector<PluginInfo> getPluginsInfo() const final
 		{
@@ -49,15 +181,86 @@ namespace pp
 				result.push_back(key);
 			return result;
 		}
+
+		std::size_t removePlugin(const std::string& pluginName) final
+		{
+			// PluginInfo isn't assignable so the kept handlers are copied
+			std::vector<typename HandlersCollection::value_type> kept;
+			std::vector<HandlerState> keptStates;
+			for (std::size_t i = 0; i < this->size(); ++i)
+				if ((*this)[i].first.name != pluginName)
+				{
+					kept.push_back((*this)[i]);
+					keptStates.push_back(m_states[i]);
+				}
+
+			const std::size_t removedCount = this->size() - kept.size();
+			this->swap(kept);
+			m_states.swap(keptStates);
+			return removedCount;
+		}
+
+	private:
+		static std::unique_ptr<HandlersCollectionBase> relocateFrom(HandlersCollectionBase& from)
+		{
+			HandlersCollection& source = static_cast<HandlersCollection&>(from);
+			auto result = std::make_unique<HandlersCollection>(source.m_cacheCapacity, source.m_cacheShardsCount);
+			result->swap(source);
+			result->m_states.swap(source.m_states);
+			return result;
+		}
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	// Event types whose receivers may consume the event (e.g. input 
+	// events handled by the first interested plugin) provide a static
+	// function telling if the result of a receiver stops propagation:
+	//		static bool stopsPropagation(const ResultType& result);
+	// Receivers of such events are called one by one and the ones 
+	// after the consuming receiver aren't called at all.
+	template <typename T, typename = void>
+	struct IsStoppable : std::false_type {};
+
+	template <typename T>
+	struct IsStoppable<T, std::void_t<decltype(T::stopsPropagation(std::declval<const typename T::Result&>()))>> : std::true_type {};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Ordering constraints of an event receiver. Receivers of the same
+	// event that depend on each other's side effects (e.g. physics 
+	// before rendering) declare it here, all the others are considered
+	// independent and may run concurrently.
+	class ReceiverOrder
+	{
+	public:
+		// names of plugins whose receivers of the same event must 
+		// finish before this receiver starts
+		std::vector<std::string> after;
+
+		// names of plugins whose receivers of the same event may start
+		// only after this receiver finishes
+		std::vector<std::string> before;
+
+		// receivers with higher priority get lower indices and are 
+		// called first unless the constraints above say otherwise, 
+		// equal priorities keep the registration order
+		int priority = 0;
 	};
 
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
-	// This is the base class for containers of event receivers.
+	// This is the base class for containers of event receivers. It also
+	// keeps the dependency graph (DAG) of the receivers which is built 
+	// once per registration so dispatching doesn't have to resolve 
+	// the ordering constraints.
 	class ReceiversCollectionBase
 	{
 	public:
+		// see HandlersCollectionBase::Relocator
+		using Relocator = std::unique_ptr<ReceiversCollectionBase>(*)(ReceiversCollectionBase& from);
+
 		virtual ~ReceiversCollectionBase() = default;
 
 		// @returns event info of event that can be handled by 
@@ -69,6 +272,103 @@ namespace pp
 		//		receivers to the user before casting the collection and
 		//		accessing the receivers directly
 		virtual std::vector<PluginInfo> getPluginsInfo() const = 0;
+
+		// @returns true if any of the receivers declared ordering 
+		//		constraints
+		bool hasDependencies() const { return m_hasDependencies; }
+
+		// @returns indices of receivers that have to wait for the 
+		//		receiver with given index
+		const std::vector<int>& getSuccessors(int index) const { return m_successors[index]; }
+
+		// @returns number of receivers that have to finish before the
+		//		receiver with given index can start
+		int getPredecessorsCount(int index) const { return m_predecessorsCount[index]; }
+
+		// @returns indices of all receivers in topological order, 
+		//		receivers without constraints between them keep the
+		//		priority and registration order
+		const std::vector<int>& getExecutionOrder() const { return m_executionOrder; }
+
+		// @returns ordering constraints that were ignored because they
+		//		contradict constraints of receivers with lower indices,
+		//		pairs of plugin names: the first was supposed to run 
+		//		before the second
+		const std::vector<std::pair<std::string, std::string>>& getIgnoredConstraints() const { return m_ignoredConstraints; }
+
+		// @returns mailbox the receiver with given index has to be 
+		//		called on or null if it can be called on any thread
+		const std::shared_ptr<Mailbox>& getMailbox(int index) const { return m_states[index].mailbox; }
+
+		// @returns true if any of the receivers has to be called on its
+		//		plugin's mailbox
+		bool hasMailboxes() const { return m_hasMailboxes; }
+
+		// @returns usage of the plugin that registered the receiver 
+		//		with given index, null if usage tracking is disabled
+		const std::shared_ptr<PluginUsage>& getUsage(int index) const { return m_states[index].usage; }
+
+		// @returns new collection with all receivers of this one, see
+		//		HandlersCollectionBase::relocate
+		std::unique_ptr<ReceiversCollectionBase> relocate() { return m_states.front().relocator(*this); }
+
+		// Removes all receivers registered by the plugin with given name.
+		// @returns number of removed receivers
+		// @param pluginName - name of the plugin
+		virtual std::size_t removePlugin(const std::string& pluginName) = 0;
+
+	protected:
+		class ReceiverState
+		{
+		public:
+			std::string pluginName;
+			ReceiverOrder order;
+			std::shared_ptr<Mailbox> mailbox;
+			std::shared_ptr<PluginUsage> usage;
+			// registration order, see Router::suspendPlugin
+			std::uint64_t sequence = 0;
+			Relocator relocator = nullptr;
+		};
+
+		// Adds state of a newly registered receiver and rebuilds the
+		// graph. Receivers are sorted by their priority and sequence so
+		// dispatching never sorts them.
+		// @returns index at which the receiver belongs
+		// @param state - state of the receiver
+		std::size_t addReceiverState(ReceiverState state);
+
+		// Removes states of receivers of given plugin and rebuilds the
+		// graph.
+		void removeReceiverStates(const std::string& pluginName);
+
+		// Moves states and the graph of all receivers from the other 
+		// collection.
+		void moveReceiverStates(ReceiversCollectionBase& from)
+		{
+			m_states.swap(from.m_states);
+			m_hasMailboxes = from.m_hasMailboxes;
+			m_successors.swap(from.m_successors);
+			m_predecessorsCount.swap(from.m_predecessorsCount);
+			m_executionOrder.swap(from.m_executionOrder);
+			m_ignoredConstraints.swap(from.m_ignoredConstraints);
+			m_hasDependencies = from.m_hasDependencies;
+		}
+
+	private:
+		void buildGraph();
+
+		// @returns true if the receiver 'to' can be reached from 'from'
+		//		following the edges added so far
+		bool isReachable(int from, int to) const;
+
+		std::vector<ReceiverState> m_states;
+		bool m_hasMailboxes = false;
+
+		std::vector<std::vector<int>> m_successors;
+		std::vector<int> m_predecessorsCount;
+		std::vector<int> m_executionOrder;
+		std::vector<std::pair<std::string, std::string>> m_ignoredConstraints;
+		bool m_hasDependencies = false;
 	};
 
 	//-------------------------------------------------------------------------------------------------------
@@ -79,18 +379,178 @@ namespace pp
 	// @tparam T - type of an event that can be processed by all 
 	//		receivers present in this collection
 	template <typename T>
-	class ReceiversCollection :
-		public ReceiversCollectionBase,
-		public std::vector<std::pair<PluginInfo, std::function<typename T::Result(T)>>>
+	class ReceiversCollection : public ReceiversCollectionBase
 	{
 	public:
+		using Receiver = std::pair<PluginInfo, std::function<typename T::Result(const T&)>>;
+
+		// Registers the receiver along with its ordering constraints
+		// and mailbox (null if it may be called on any thread). 
+		// Receivers are sorted by priority and registration order so 
+		// receivers of a reloaded plugin get their original indices 
+		// back.
+		// @param sequence - registration order of the receiver
+		// @param usage - usage of the plugin, may be null
+		void add(PluginInfo info, std::function<typename T::Result(const T&)> receiver, ReceiverOrder order, 
+			std::shared_ptr<Mailbox> mailbox, std::uint64_t sequence, std::shared_ptr<PluginUsage> usage)
+		{
+			const std::size_t position = addReceiverState({ info.name, std::move(order), std::move(mailbox), std::move(usage), sequence, &ReceiversCollection::relocateFrom });
+			insertEntry<Receiver>(m_receivers, position, { std::move(info), std::move(receiver) });
+		}
+
+		// @returns number of registered receivers
+		std::size_t size() const { return m_receivers.size(); }
+		bool empty() const { return m_receivers.empty(); }
+
+		// @returns receiver with given index and info of its plugin
+		const Receiver& at(std::size_t index) const { return m_receivers.at(index); }
+
 		const EventInfo& getEventInfo() const final { return T::Info; }
 		std::vector<PluginInfo> getPluginsInfo() const final
 		{
 			std::vector<PluginInfo> result;
-			for (auto[key, value] : *this)
-				result.push_back(key);
+			for (const Receiver& receiver : m_receivers)
+				result.push_back(receiver.first);
+			return result;
+		}
+
+		std::size_t removePlugin(const std::string& pluginName) final
+		{
+			// PluginInfo isn't assignable so the kept receivers are copied
+			std::vector<Receiver> kept;
+			for (const Receiver& receiver : m_receivers)
+				if (receiver.first.name != pluginName)
+					kept.push_back(receiver);
+
+			const std::size_t removedCount = m_receivers.size() - kept.size();
+			m_receivers.swap(kept);
+			removeReceiverStates(pluginName);
+			return removedCount;
+		}
+
+	private:
+		static std::unique_ptr<ReceiversCollectionBase> relocateFrom(ReceiversCollectionBase& from)
+		{
+			ReceiversCollection& source = static_cast<ReceiversCollection&>(from);
+			auto result = std::make_unique<ReceiversCollection>();
+			result->m_receivers.swap(source.m_receivers);
+			result->moveReceiverStates(source);
 			return result;
 		}
+
+		// indices match the states of the base class
+		std::vector<Receiver> m_receivers;
 	};
-} // namespace pp
\ No newline at end of file
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::size_t ReceiversCollectionBase::addReceiverState(ReceiverState state)
+	{
+		const auto it = std::upper_bound(m_states.begin(), m_states.end(), state, [](const ReceiverState& left, const ReceiverState& right)
+		{
+			if (left.order.priority != right.order.priority)
+				return left.order.priority > right.order.priority;
+			return left.sequence < right.sequence;
+		});
+		const auto inserted = m_states.insert(it, std::move(state));
+		const std::size_t position = inserted - m_states.begin();
+
+		buildGraph();
+		return position;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void ReceiversCollectionBase::removeReceiverStates(const std::string& pluginName)
+	{
+		m_states.erase(std::remove_if(m_states.begin(), m_states.end(), 
+			[&pluginName](const ReceiverState& state) { return state.pluginName == pluginName; }), m_states.end());
+
+		buildGraph();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void ReceiversCollectionBase::buildGraph()
+	{
+		const int count = static_cast<int>(m_states.size());
+		m_successors.assign(count, {});
+		m_predecessorsCount.assign(count, 0);
+		m_ignoredConstraints.clear();
+
+		m_hasDependencies = false;
+		m_hasMailboxes = false;
+		for (const ReceiverState& state : m_states)
+		{
+			m_hasDependencies = m_hasDependencies || !state.order.after.empty() || !state.order.before.empty();
+			m_hasMailboxes = m_hasMailboxes || state.mailbox;
+		}
+
+		// Constraints are plugin supplied so they may be cyclic. Edges
+		// are added in order of indices and an edge closing a cycle is
+		// ignored, only the conflicting constraint is dropped then.
+		const auto addEdge = [&](int from, int to)
+		{
+			if (from == to)
+				return;
+			std::vector<int>& successors = m_successors[from];
+			if (std::find(successors.begin(), successors.end(), to) != successors.end())
+				return;
+			if (isReachable(to, from))
+			{
+				m_ignoredConstraints.emplace_back(m_states[from].pluginName, m_states[to].pluginName);
+				return;
+			}
+			successors.push_back(to);
+			++m_predecessorsCount[to];
+		};
+
+		for (int i = 0; i < count; ++i)
+			for (int j = 0; j < count; ++j)
+			{
+				const ReceiverOrder& order = m_states[i].order;
+				const std::string& name = m_states[j].pluginName;
+				if (std::find(order.after.begin(), order.after.end(), name) != order.after.end())
+					addEdge(j, i);
+				if (std::find(order.before.begin(), order.before.end(), name) != order.before.end())
+					addEdge(i, j);
+			}
+
+		// Kahn's algorithm, always picking the ready receiver with the
+		// lowest index (highest priority, registered first)
+		std::vector<int> remaining = m_predecessorsCount;
+		std::vector<bool> visited(count, false);
+		m_executionOrder.clear();
+		while (static_cast<int>(m_executionOrder.size()) < count)
+		{
+			int next = -1;
+			for (int i = 0; i < count && next < 0; ++i)
+				if (!visited[i] && remaining[i] == 0)
+					next = i;
+
+			// the graph is acyclic so there always is a ready receiver
+			assert(next >= 0);
+			visited[next] = true;
+			m_executionOrder.push_back(next);
+			for (const int successor : m_successors[next])
+				--remaining[successor];
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool ReceiversCollectionBase::isReachable(int from, int to) const
+	{
+		std::vector<bool> visited(m_successors.size(), false);
+		std::vector<int> pending{ from };
+		while (!pending.empty())
+		{
+			const int current = pending.back();
+			pending.pop_back();
+			if (current == to)
+				return true;
+			if (visited[current])
+				continue;
+
+			visited[current] = true;
+			pending.insert(pending.end(), m_successors[current].begin(), m_successors[current].end());
+		}
+		return false;
+	}
+} // namespace pp
@@ -50,39 +50,39 @@ namespace pp
 	};
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator== (const IntentInfo& left, const IntentInfo& right)
+	inline bool operator== (const IntentInfo& left, const IntentInfo& right)
 	{
 		return left.name == right.name && left.version == right.version;
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator!= (const IntentInfo& left, const IntentInfo& right)
+	inline bool operator!= (const IntentInfo& left, const IntentInfo& right)
 	{
 		return !(left == right);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator< (const IntentInfo& left, const IntentInfo& right)
+	inline bool operator< (const IntentInfo& left, const IntentInfo& right)
 	{
-		return left.version < right.version || left.name < right.name;
+		return left.name < right.name || (left.name == right.name && left.version < right.version);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator> (const IntentInfo& left, const IntentInfo& right)
+	inline bool operator> (const IntentInfo& left, const IntentInfo& right)
 	{
-		return left.version > right.version || left.name > right.name;
+		return left.name > right.name || (left.name == right.name && left.version > right.version);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator<= (const IntentInfo& left, const IntentInfo& right)
+	inline bool operator<= (const IntentInfo& left, const IntentInfo& right)
 	{
-		return left.version <= right.version || left.name <= right.name;
+		return !(left > right);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator>= (const IntentInfo& left, const IntentInfo& right)
+	inline bool operator>= (const IntentInfo& left, const IntentInfo& right)
 	{
-		return left.version >= right.version || left.name >= right.name;
+		return !(left < right);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
@@ -106,38 +106,38 @@ namespace pp
 	};
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator== (const EventInfo& left, const EventInfo& right)
+	inline bool operator== (const EventInfo& left, const EventInfo& right)
 	{
 		return left.name == right.name && left.version == right.version;
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator!= (const EventInfo& left, const EventInfo& right)
+	inline bool operator!= (const EventInfo& left, const EventInfo& right)
 	{
 		return !(left == right);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator< (const EventInfo& left, const EventInfo& right)
+	inline bool operator< (const EventInfo& left, const EventInfo& right)
 	{
-		return left.version < right.version || left.name < right.name;
+		return left.name < right.name || (left.name == right.name && left.version < right.version);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator> (const EventInfo& left, const EventInfo& right)
+	inline bool operator> (const EventInfo& left, const EventInfo& right)
 	{
-		return left.version > right.version || left.name > right.name;
+		return left.name > right.name || (left.name == right.name && left.version > right.version);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator<= (const EventInfo& left, const EventInfo& right)
+	inline bool operator<= (const EventInfo& left, const EventInfo& right)
 	{
-		return left.version <= right.version || left.name <= right.name;
+		return !(left > right);
 	}
 
 	//-------------------------------------------------------------------------------------------------------
-	bool operator>= (const EventInfo& left, const EventInfo& right)
+	inline bool operator>= (const EventInfo& left, const EventInfo& right)
 	{
-		return left.version >= right.version || left.name >= right.name;
+		return !(left < right);
 	}
 } // namespace pp
\ No newline at end of file
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+namespace pp
+{
+	//-------------------------------------------------------------------------------------------------------
+	// Intent types that are pure functions of their fields opt into
+	// result caching by providing a static function returning a key
+	// with std::hash specialization and equality operator:
+	//		static KeyType cacheKey(const IntentType& intent);
+	// Results of such intents are served from the cache when an equal
+	// intent is dispatched again.
+	template <typename T, typename = void>
+	struct IsCacheable : std::false_type {};
+
+	template <typename T>
+	struct IsCacheable<T, std::void_t<decltype(T::cacheKey(std::declval<const T&>()))>> : std::true_type {};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Counters of the intent results cache.
+	class IntentCacheStats
+	{
+	public:
+		std::size_t hitsCount = 0;
+		std::size_t missesCount = 0;
+		// entries dropped because a shard was full
+		std::size_t evictionsCount = 0;
+		// how many times the whole cache was cleared
+		std::size_t invalidationsCount = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// This is the base class for caches of intent results.
+	class IntentCacheBase
+	{
+	public:
+		virtual ~IntentCacheBase() = default;
+
+		// Removes all cached results. Called when the set of handlers
+		// that may process the intent changes.
+		virtual void invalidate() = 0;
+
+		// @returns counters of this cache
+		virtual IntentCacheStats getStats() const = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Bounded LRU cache of results of the specific intent type. It's
+	// split into shards with separate locks so concurrent dispatching
+	// doesn't serialize on a single mutex. All methods are thread safe.
+	// @tparam T - cacheable intent type
+	template <typename T>
+	class IntentCache final : public IntentCacheBase
+	{
+	public:
+		using Key = std::decay_t<decltype(T::cacheKey(std::declval<const T&>()))>;
+		using Result = typename T::Result;
+
+		// @param capacity - maximal number of cached results
+		// @param shardsCount - number of independently locked shards
+		IntentCache(std::size_t capacity, std::size_t shardsCount);
+
+		// Cached results are valid only for the handler that produced
+		// them. If the selector chose another handler than previously
+		// the cache is invalidated.
+		// @param handlerIndex - index of the handler chosen to process
+		//		the intent
+		void selectHandler(int handlerIndex);
+
+		// @returns current generation of the cache, it has to be passed
+		//		to 'insert' so results computed before invalidation are
+		//		not stored
+		std::uint64_t getGeneration() const { return m_generation.load(std::memory_order_acquire); }
+
+		// @returns cached result or empty optional on cache miss
+		// @param key - cache key of the intent
+		std::optional<Result> find(const Key& key);
+
+		// Stores the result evicting the least recently used entry of
+		// the shard if it's full.
+		// @param key - cache key of the intent
+		// @param generation - generation read before processing the
+		//		intent
+		// @param result - result returned by the handler
+		void insert(Key key, std::uint64_t generation, Result result);
+
+		void invalidate() final;
+		IntentCacheStats getStats() const final;
+
+	private:
+		struct Shard
+		{
+			std::mutex mutex;
+			std::list<std::pair<Key, Result>> entries; // most recently used first
+			std::unordered_map<Key, typename std::list<std::pair<Key, Result>>::iterator> index;
+		};
+
+		// std::hash of integers is usually the identity so the hash is
+		// mixed before choosing the shard, otherwise keys differing only
+		// in high bits would all land in the same shard
+		Shard& getShard(const Key& key)
+		{
+			const std::uint64_t hash = static_cast<std::uint64_t>(std::hash<Key>{}(key)) * 0x9E3779B97F4A7C15ull;
+			return *m_shards[(hash >> 32) % m_shards.size()];
+		}
+
+		std::vector<std::unique_ptr<Shard>> m_shards;
+		std::size_t m_shardCapacity = 0;
+
+		std::atomic<int> m_handlerIndex = -1;
+		std::atomic<std::uint64_t> m_generation = 0;
+
+		std::atomic<std::size_t> m_hitsCount = 0;
+		std::atomic<std::size_t> m_missesCount = 0;
+		std::atomic<std::size_t> m_evictionsCount = 0;
+		std::atomic<std::size_t> m_invalidationsCount = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline IntentCache<T>::IntentCache(std::size_t capacity, std::size_t shardsCount)
+	{
+		if (shardsCount == 0)
+			shardsCount = 1;
+
+		m_shardCapacity = std::max<std::size_t>(1, (capacity + shardsCount - 1) / shardsCount);
+		for (std::size_t i = 0; i < shardsCount; ++i)
+			m_shards.push_back(std::make_unique<Shard>());
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline void IntentCache<T>::selectHandler(int handlerIndex)
+	{
+		if (m_handlerIndex.load(std::memory_order_relaxed) == handlerIndex)
+			return;
+
+		const int previousIndex = m_handlerIndex.exchange(handlerIndex);
+		if (previousIndex >= 0 && previousIndex != handlerIndex)
+			invalidate();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline std::optional<typename T::Result> IntentCache<T>::find(const Key& key)
+	{
+		Shard& shard = getShard(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		const auto it = shard.index.find(key);
+		if (it == shard.index.end())
+		{
+			m_missesCount.fetch_add(1, std::memory_order_relaxed);
+			return {};
+		}
+
+		shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+		m_hitsCount.fetch_add(1, std::memory_order_relaxed);
+		return it->second->second;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline void IntentCache<T>::insert(Key key, std::uint64_t generation, Result result)
+	{
+		Shard& shard = getShard(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		// handlers changed while the result was computed
+		if (generation != m_generation.load(std::memory_order_acquire))
+			return;
+
+		const auto it = shard.index.find(key);
+		if (it != shard.index.end())
+		{
+			it->second->second = std::move(result);
+			shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+			return;
+		}
+
+		if (shard.entries.size() >= m_shardCapacity)
+		{
+			shard.index.erase(shard.entries.back().first);
+			shard.entries.pop_back();
+			m_evictionsCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		shard.entries.emplace_front(key, std::move(result));
+		shard.index.emplace(std::move(key), shard.entries.begin());
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline void IntentCache<T>::invalidate()
+	{
+		// Bumped before clearing any shard so results computed with 
+		// the older generation are either rejected by 'insert' or 
+		// land in a shard that is cleared below.
+		m_generation.fetch_add(1, std::memory_order_acq_rel);
+
+		for (const std::unique_ptr<Shard>& shard : m_shards)
+		{
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			shard->index.clear();
+			shard->entries.clear();
+		}
+		m_invalidationsCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline IntentCacheStats IntentCache<T>::getStats() const
+	{
+		IntentCacheStats result;
+		result.hitsCount = m_hitsCount.load(std::memory_order_relaxed);
+		result.missesCount = m_missesCount.load(std::memory_order_relaxed);
+		result.evictionsCount = m_evictionsCount.load(std::memory_order_relaxed);
+		result.invalidationsCount = m_invalidationsCount.load(std::memory_order_relaxed);
+		return result;
+	}
+
+} // namespace pp
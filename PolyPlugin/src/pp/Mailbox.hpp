@@ -0,0 +1,314 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+namespace pp
+{
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Message queue processed by a single dedicated worker thread. In
+	// actor execution mode (see Router::enableActorExecution) every
+	// plugin gets its own mailbox so its handlers are never called
+	// concurrently and they don't need any locks.
+	class Mailbox final
+	{
+	public:
+		// @param core - index of the CPU core the worker should be
+		//		pinned to, ignored on platforms without affinity API
+		Mailbox(std::optional<unsigned> core = {});
+
+		// Processes all messages that are already queued and stops
+		// the worker. If the last reference is released by a message
+		// of this mailbox the worker finishes the queue on its own.
+		~Mailbox();
+
+		Mailbox(const Mailbox&) = delete;
+		Mailbox& operator=(const Mailbox&) = delete;
+
+		// Processes all messages that are already queued and waits
+		// until the worker stops. Messages posted afterwards are 
+		// rejected. Called from the worker itself it only asks the 
+		// worker to stop once the current message returns.
+		void stop();
+
+		// Queues the message. Messages are processed in order of
+		// posting. Messages must not throw.
+		// @returns false if the mailbox is stopped, the message is 
+		//		dropped then
+		// @param message - function to call on the worker thread
+		bool post(std::function<void()> message);
+
+		// Wakes the worker up if it waits in 'processUntil' so it 
+		// checks its predicate again. Unlike an empty message it works
+		// on a stopped mailbox as well.
+		void wake() { wake(*m_state); }
+
+		// Calls the function on the worker thread and waits for its
+		// result. If called from the worker itself the function is
+		// called directly. If called from another mailbox's worker
+		// that worker keeps processing its own messages while waiting
+		// so mailboxes calling each other can't deadlock. The caller's
+		// messages are then re-entered: another handler of the 
+		// calling plugin may run on the same thread while the one 
+		// that made the call is suspended in it. Handlers are still
+		// never called concurrently but state kept across such a call
+		// may change during it.
+		// @returns value returned by the function, exceptions are
+		//		rethrown in the calling thread
+		// @throws std::runtime_error if the mailbox is stopped (e.g. 
+		//		its plugin was unregistered or evicted) instead of 
+		//		waiting for a worker that is gone
+		// @param function - function to call
+		template <typename Function>
+		auto call(Function&& function) -> decltype(function());
+
+		// Processes messages of this mailbox until 'done' returns true.
+		// Must be called from the worker of this mailbox.
+		// @param done - predicate checked after every message
+		template <typename Predicate>
+		void processUntil(Predicate done);
+
+		// @returns true if called from the worker of this mailbox
+		bool isCurrent() const { return s_current == this; }
+
+		// @returns mailbox whose worker is the calling thread or
+		//		nullptr if it's not a mailbox worker
+		static Mailbox* getCurrent() { return s_current; }
+
+	private:
+		// Owned by the worker as well so it can outlive the mailbox.
+		struct State
+		{
+			std::mutex mutex;
+			std::condition_variable messagesAvailable;
+			std::deque<std::function<void()>> messages;
+			bool stop = false;
+		};
+
+		static bool post(State& state, std::function<void()> message);
+		static void wake(State& state);
+		static bool processOne(State& state, std::unique_lock<std::mutex>& lock);
+		static void workerLoop(const std::shared_ptr<State>& state);
+		static void pinCurrentThread(unsigned core);
+
+		std::shared_ptr<State> m_state;
+		std::thread m_thread;
+
+		static inline thread_local Mailbox* s_current = nullptr;
+	}; // class Mailbox
+
+	//-------------------------------------------------------------------------------------------------------
+	inline Mailbox::Mailbox(std::optional<unsigned> core)
+		: m_state(std::make_shared<State>())
+	{
+		// the mailbox itself is only used to identify the worker, the
+		// thread touches nothing but the state
+		m_thread = std::thread([mailbox = this, state = m_state, core]
+		{
+			s_current = mailbox;
+			if (core)
+				pinCurrentThread(*core);
+			workerLoop(state);
+		});
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline Mailbox::~Mailbox()
+	{
+		stop();
+
+		// The last reference may be released by a message of this
+		// mailbox, the worker can't join itself then. It keeps the 
+		// state alive and mustn't be recognized as this mailbox's 
+		// worker anymore.
+		if (m_thread.joinable())
+		{
+			s_current = nullptr;
+			m_thread.detach();
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Mailbox::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_state->mutex);
+			m_state->stop = true;
+		}
+		m_state->messagesAvailable.notify_one();
+
+		if (!isCurrent() && m_thread.joinable())
+			m_thread.join();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool Mailbox::post(std::function<void()> message)
+	{
+		return post(*m_state, std::move(message));
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool Mailbox::post(State& state, std::function<void()> message)
+	{
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (state.stop)
+				return false;
+			state.messages.push_back(std::move(message));
+		}
+		state.messagesAvailable.notify_one();
+		return true;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Mailbox::wake(State& state)
+	{
+		// Taking the lock prevents the worker from missing the
+		// notification between checking its predicate and sleeping.
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+		}
+		state.messagesAvailable.notify_one();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename Function>
+	inline auto Mailbox::call(Function&& function) -> decltype(function())
+	{
+		using Result = decltype(function());
+		static_assert(!std::is_void_v<Result>, "Mailbox::call requires function returning a value");
+
+		if (isCurrent())
+			return function();
+
+		struct CallState
+		{
+			std::mutex mutex;
+			std::condition_variable finished;
+			std::atomic<bool> done = false;
+			std::optional<Result> result;
+			std::exception_ptr exception;
+		} state;
+
+		// the waiting worker is woken up through its state which stays
+		// valid even if a message releases the caller mailbox
+		Mailbox* const caller = getCurrent();
+		std::shared_ptr<State> callerState = caller ? caller->m_state : nullptr;
+		const bool isPosted = post([&state, &function, callerState]
+		{
+			try
+			{
+				state.result.emplace(function());
+			}
+			catch (...)
+			{
+				state.exception = std::current_exception();
+			}
+
+			// the caller may return as soon as 'done' is set so the
+			// state mustn't be touched afterwards
+			if (callerState)
+			{
+				state.done = true;
+				wake(*callerState);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(state.mutex);
+				state.done = true;
+				state.finished.notify_one();
+			}
+		});
+		if (!isPosted)
+			throw std::runtime_error("Mailbox is stopped");
+
+		if (caller)
+			caller->processUntil([&state] { return state.done.load(); });
+		else
+		{
+			std::unique_lock<std::mutex> lock(state.mutex);
+			state.finished.wait(lock, [&state] { return state.done.load(); });
+		}
+
+		if (state.exception)
+			std::rethrow_exception(state.exception);
+		return std::move(*state.result);
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename Predicate>
+	inline void Mailbox::processUntil(Predicate done)
+	{
+		// a message may release the last reference to the mailbox
+		const std::shared_ptr<State> state = m_state;
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		while (!done())
+		{
+			state->messagesAvailable.wait(lock, [&state, &done] { return !state->messages.empty() || done(); });
+			processOne(*state, lock);
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool Mailbox::processOne(State& state, std::unique_lock<std::mutex>& lock)
+	{
+		if (state.messages.empty())
+			return false;
+
+		std::function<void()> message = std::move(state.messages.front());
+		state.messages.pop_front();
+
+		lock.unlock();
+		message();
+		message = nullptr;
+		lock.lock();
+		return true;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Mailbox::workerLoop(const std::shared_ptr<State>& state)
+	{
+		std::unique_lock<std::mutex> lock(state->mutex);
+		while (true)
+		{
+			state->messagesAvailable.wait(lock, [&state] { return state->stop || !state->messages.empty(); });
+			if (!processOne(*state, lock) && state->stop)
+				return;
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Mailbox::pinCurrentThread(unsigned core)
+	{
+#if defined(_WIN32)
+		SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(core % CPU_SETSIZE, &cpuSet);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+#else
+		(void)core;
+#endif
+	}
+
+} // namespace pp
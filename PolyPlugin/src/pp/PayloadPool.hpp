@@ -0,0 +1,456 @@
+#pragma once
+
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace pp
+{
+	class PayloadPool;
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Configuration of a PayloadPool.
+	class PayloadPoolOptions
+	{
+	public:
+		// size of the smallest size class, rounded up to a power of 2
+		std::size_t minBlockSize = 256;
+		// size of the largest pooled size class, bigger payloads are
+		// allocated exactly and freed as soon as they're released
+		std::size_t maxBlockSize = std::size_t(16) << 20;
+		// total capacity of free blocks kept for reuse over all size
+		// classes, released blocks that don't fit are freed
+		std::size_t maxCachedBytes = std::size_t(64) << 20;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Counters of a PayloadPool.
+	class PayloadPoolStats
+	{
+	public:
+		std::size_t acquiresCount = 0;
+		// acquires served from the free lists without allocating
+		std::size_t reusesCount = 0;
+		// buffers referenced by any Payload or PayloadWriter
+		std::size_t liveBuffersCount = 0;
+		std::size_t cachedBuffersCount = 0;
+		std::size_t cachedBytes = 0;
+	};
+
+	namespace detail
+	{
+		class PayloadPoolState;
+
+		//-------------------------------------------------------------------------------------------------------
+		// Header placed before the bytes of every payload buffer.
+		struct alignas(alignof(std::max_align_t)) PayloadBlock
+		{
+			std::atomic<std::uint32_t> refsCount;
+			// index of the size class or -1 for oversized blocks
+			int sizeClass;
+			std::size_t capacity;
+			std::size_t size;
+			PayloadPoolState* pool;
+
+			std::byte* getData() { return reinterpret_cast<std::byte*>(this + 1); }
+		};
+
+		//-------------------------------------------------------------------------------------------------------
+		// Shared part of the pool. It's kept alive by the pool and by
+		// every buffer in use so payloads may outlive the pool. Blocks
+		// are allocated and freed by functions of the module that
+		// created the pool, so they can be released in a plugin using
+		// a different C runtime.
+		class PayloadPoolState final
+		{
+		public:
+			PayloadPoolState(const PayloadPoolOptions& options);
+
+			PayloadBlock* acquire(std::size_t size);
+			void release(PayloadBlock* block);
+
+			// Frees all cached blocks. If 'close' is true released blocks
+			// aren't cached anymore.
+			void trim(bool close);
+			void removeReference();
+
+			PayloadPoolStats getStats() const;
+
+		private:
+			struct SizeClass
+			{
+				std::mutex mutex;
+				std::vector<PayloadBlock*> freeBlocks;
+			};
+
+			static void* allocateBlock(std::size_t size) { return std::malloc(size); }
+			static void freeBlock(void* block) { std::free(block); }
+			static void destroy(PayloadPoolState* state) { delete state; }
+
+			void* (*m_allocate)(std::size_t) = &allocateBlock;
+			void (*m_free)(void*) = &freeBlock;
+			void (*m_destroy)(PayloadPoolState*) = &destroy;
+
+			std::size_t m_minBlockSize = 0;
+			std::size_t m_maxCachedBytes = 0;
+			std::vector<std::unique_ptr<SizeClass>> m_sizeClasses;
+			std::atomic<bool> m_closed = false;
+
+			// one reference held by the pool, one by every live buffer
+			std::atomic<std::size_t> m_referencesCount = 1;
+
+			std::atomic<std::size_t> m_acquiresCount = 0;
+			std::atomic<std::size_t> m_reusesCount = 0;
+			std::atomic<std::size_t> m_cachedBuffersCount = 0;
+			std::atomic<std::size_t> m_cachedBytes = 0;
+		};
+	} // namespace detail
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Immutable, reference counted view of a payload buffer. Copying a
+	// Payload only increments the counter so the same bytes can be
+	// passed to any number of receivers or kept after the handler
+	// returns. The buffer goes back to its pool when the last Payload
+	// referencing it is destroyed. Payload is thread safe as much as
+	// std::shared_ptr is.
+	class Payload final
+	{
+	public:
+		Payload() = default;
+		Payload(const Payload& other) : m_block(other.m_block) { addReference(); }
+		Payload(Payload&& other) noexcept : m_block(std::exchange(other.m_block, nullptr)) {}
+		~Payload() { removeReference(); }
+
+		Payload& operator=(const Payload& other);
+		Payload& operator=(Payload&& other) noexcept;
+
+		const std::byte* data() const { return m_block ? m_block->getData() : nullptr; }
+		std::size_t size() const { return m_block ? m_block->size : 0; }
+		bool empty() const { return size() == 0; }
+		explicit operator bool() const { return m_block != nullptr; }
+
+		const std::byte* begin() const { return data(); }
+		const std::byte* end() const { return data() + size(); }
+
+		// @returns number of Payloads referencing the same buffer, 0 if
+		//		this one is empty
+		std::uint32_t getUseCount() const { return m_block ? m_block->refsCount.load(std::memory_order_relaxed) : 0; }
+
+	private:
+		friend class PayloadWriter;
+
+		explicit Payload(detail::PayloadBlock* block) : m_block(block) {}
+
+		void addReference() const;
+		void removeReference();
+
+		detail::PayloadBlock* m_block = nullptr;
+	}; // class Payload
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Uniquely owned, writable buffer acquired from a PayloadPool. It's
+	// filled by the producer and then frozen into an immutable Payload.
+	class PayloadWriter final
+	{
+	public:
+		PayloadWriter() = default;
+		PayloadWriter(PayloadWriter&& other) noexcept : m_block(std::exchange(other.m_block, nullptr)) {}
+		PayloadWriter& operator=(PayloadWriter&& other) noexcept;
+		~PayloadWriter() { Payload released(std::exchange(m_block, nullptr)); }
+
+		PayloadWriter(const PayloadWriter&) = delete;
+		PayloadWriter& operator=(const PayloadWriter&) = delete;
+
+		std::byte* data() { return m_block ? m_block->getData() : nullptr; }
+		std::size_t size() const { return m_block ? m_block->size : 0; }
+
+		// @returns number of bytes the buffer can hold without
+		//		acquiring another one
+		std::size_t getCapacity() const { return m_block ? m_block->capacity : 0; }
+
+		// Changes the size of the payload, contents are preserved.
+		// @param size - new size, must not exceed the capacity
+		void resize(std::size_t size)
+		{
+			assert(m_block && size <= m_block->capacity);
+			m_block->size = size;
+		}
+
+		// Makes the buffer immutable, the writer is empty afterwards.
+		// @returns payload referencing the written bytes
+		Payload freeze() && { return Payload(std::exchange(m_block, nullptr)); }
+
+	private:
+		friend class PayloadPool;
+
+		explicit PayloadWriter(detail::PayloadBlock* block) : m_block(block) {}
+
+		detail::PayloadBlock* m_block = nullptr;
+	}; // class PayloadWriter
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Pool of payload buffers for large intents and events (images,
+	// meshes, serialized documents). Buffers are rounded up to power of
+	// 2 size classes and released buffers are kept on per class free
+	// lists, so steady traffic doesn't allocate. Every buffer remembers
+	// its pool and returns to it from whichever thread or plugin drops
+	// the last reference. All methods are thread safe.
+	class PayloadPool final
+	{
+	public:
+		// @param options - size classes and limits of the free lists
+		PayloadPool(const PayloadPoolOptions& options = {}) : m_state(new detail::PayloadPoolState(options)) {}
+
+		// Frees cached buffers. Payloads still in use stay valid and
+		// are freed when they're released.
+		~PayloadPool()
+		{
+			m_state->trim(true);
+			m_state->removeReference();
+		}
+
+		PayloadPool(const PayloadPool&) = delete;
+		PayloadPool& operator=(const PayloadPool&) = delete;
+
+		// @returns writable buffer of given size, contents are
+		//		uninitialized
+		// @param size - size of the payload in bytes
+		PayloadWriter acquire(std::size_t size) { return PayloadWriter(m_state->acquire(size)); }
+
+		// @returns payload holding a copy of given bytes
+		// @param data - bytes to copy
+		// @param size - number of bytes
+		Payload copy(const void* data, std::size_t size)
+		{
+			PayloadWriter writer = acquire(size);
+			if (size > 0)
+				std::memcpy(writer.data(), data, size);
+			return std::move(writer).freeze();
+		}
+
+		// Frees all cached buffers.
+		void trim() { m_state->trim(false); }
+
+		// @returns counters of this pool
+		PayloadPoolStats getStats() const { return m_state->getStats(); }
+
+	private:
+		detail::PayloadPoolState* m_state = nullptr;
+	}; // class PayloadPool
+
+	//-------------------------------------------------------------------------------------------------------
+	inline Payload& Payload::operator=(const Payload& other)
+	{
+		if (this != &other)
+		{
+			other.addReference();
+			removeReference();
+			m_block = other.m_block;
+		}
+		return *this;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline Payload& Payload::operator=(Payload&& other) noexcept
+	{
+		if (this != &other)
+		{
+			removeReference();
+			m_block = std::exchange(other.m_block, nullptr);
+		}
+		return *this;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Payload::addReference() const
+	{
+		if (m_block)
+			m_block->refsCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Payload::removeReference()
+	{
+		if (m_block && m_block->refsCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			m_block->pool->release(m_block);
+		m_block = nullptr;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline PayloadWriter& PayloadWriter::operator=(PayloadWriter&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Payload released(std::exchange(m_block, nullptr));
+			m_block = std::exchange(other.m_block, nullptr);
+		}
+		return *this;
+	}
+
+	namespace detail
+	{
+		//-------------------------------------------------------------------------------------------------------
+		inline PayloadPoolState::PayloadPoolState(const PayloadPoolOptions& options)
+			: m_maxCachedBytes(options.maxCachedBytes)
+		{
+			m_minBlockSize = 1;
+			while (m_minBlockSize < options.minBlockSize)
+				m_minBlockSize <<= 1;
+
+			for (std::size_t size = m_minBlockSize; size <= options.maxBlockSize && size != 0; size <<= 1)
+				m_sizeClasses.push_back(std::make_unique<SizeClass>());
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		inline PayloadBlock* PayloadPoolState::acquire(std::size_t size)
+		{
+			int sizeClass = 0;
+			std::size_t capacity = m_minBlockSize;
+			while (capacity < size && sizeClass < static_cast<int>(m_sizeClasses.size()))
+			{
+				capacity <<= 1;
+				++sizeClass;
+			}
+			if (sizeClass == static_cast<int>(m_sizeClasses.size()))
+			{
+				sizeClass = -1;
+				capacity = size;
+			}
+
+			m_acquiresCount.fetch_add(1, std::memory_order_relaxed);
+			m_referencesCount.fetch_add(1, std::memory_order_relaxed);
+
+			PayloadBlock* block = nullptr;
+			if (sizeClass >= 0)
+			{
+				SizeClass& freeList = *m_sizeClasses[sizeClass];
+				std::lock_guard<std::mutex> lock(freeList.mutex);
+				if (!freeList.freeBlocks.empty())
+				{
+					block = freeList.freeBlocks.back();
+					freeList.freeBlocks.pop_back();
+				}
+			}
+
+			if (block)
+			{
+				m_reusesCount.fetch_add(1, std::memory_order_relaxed);
+				m_cachedBuffersCount.fetch_sub(1, std::memory_order_relaxed);
+				m_cachedBytes.fetch_sub(capacity, std::memory_order_relaxed);
+			}
+			else
+			{
+				void* const memory = m_allocate(sizeof(PayloadBlock) + capacity);
+				if (!memory)
+				{
+					removeReference();
+					throw std::bad_alloc();
+				}
+				block = new (memory) PayloadBlock();
+				block->sizeClass = sizeClass;
+				block->capacity = capacity;
+				block->pool = this;
+			}
+
+			block->refsCount.store(1, std::memory_order_relaxed);
+			block->size = size;
+			return block;
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		inline void PayloadPoolState::release(PayloadBlock* block)
+		{
+			bool cached = false;
+			if (block->sizeClass >= 0)
+			{
+				SizeClass& freeList = *m_sizeClasses[block->sizeClass];
+				std::lock_guard<std::mutex> lock(freeList.mutex);
+
+				// the bytes are reserved first so concurrent releases 
+				// into other classes can't overshoot the limit together
+				if (!m_closed.load(std::memory_order_relaxed))
+				{
+					if (m_cachedBytes.fetch_add(block->capacity, std::memory_order_relaxed) + block->capacity <= m_maxCachedBytes)
+					{
+						freeList.freeBlocks.push_back(block);
+						m_cachedBuffersCount.fetch_add(1, std::memory_order_relaxed);
+						cached = true;
+					}
+					else
+						m_cachedBytes.fetch_sub(block->capacity, std::memory_order_relaxed);
+				}
+			}
+
+			if (!cached)
+			{
+				block->~PayloadBlock();
+				m_free(block);
+			}
+			removeReference();
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		inline void PayloadPoolState::trim(bool close)
+		{
+			// blocks released after the class is swapped see the flag
+			// because it's stored before its mutex is locked
+			if (close)
+				m_closed.store(true, std::memory_order_relaxed);
+
+			for (const std::unique_ptr<SizeClass>& sizeClass : m_sizeClasses)
+			{
+				std::vector<PayloadBlock*> blocks;
+				{
+					std::lock_guard<std::mutex> lock(sizeClass->mutex);
+					blocks.swap(sizeClass->freeBlocks);
+				}
+
+				for (PayloadBlock* const block : blocks)
+				{
+					m_cachedBuffersCount.fetch_sub(1, std::memory_order_relaxed);
+					m_cachedBytes.fetch_sub(block->capacity, std::memory_order_relaxed);
+					block->~PayloadBlock();
+					m_free(block);
+				}
+			}
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		inline void PayloadPoolState::removeReference()
+		{
+			if (m_referencesCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				m_destroy(this);
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		inline PayloadPoolStats PayloadPoolState::getStats() const
+		{
+			PayloadPoolStats result;
+			result.acquiresCount = m_acquiresCount.load(std::memory_order_relaxed);
+			result.reusesCount = m_reusesCount.load(std::memory_order_relaxed);
+			result.liveBuffersCount = m_referencesCount.load(std::memory_order_relaxed) - 1;
+			result.cachedBuffersCount = m_cachedBuffersCount.load(std::memory_order_relaxed);
+			result.cachedBytes = m_cachedBytes.load(std::memory_order_relaxed);
+			return result;
+		}
+	} // namespace detail
+
+} // namespace pp
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <string>
+
+namespace pp
+{
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Memory allocated by a plugin that wasn't freed yet.
+	class MemoryUsage
+	{
+	public:
+		std::size_t allocatedBytes = 0;
+		std::size_t allocationsCount = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	// Accounting of allocations made while handlers and receivers of
+	// plugins are called. It works only if the host executable defines
+	// POLY_PLUGIN_MEMORY_ACCOUNTING() in one of its source files, which
+	// replaces the global operator new/delete with versions that keep
+	// the size and the owning plugin in a small header before every
+	// block. Memory is attributed to the plugin whose handler was
+	// running when it was allocated, even if it's freed elsewhere.
+	// Over-aligned allocations aren't counted. On Windows DLLs don't
+	// use operators replaced in the executable so only allocations of
+	// the host and statically linked plugins are counted there.
+	namespace MemoryAccounting
+	{
+		// slot 0 collects allocations made outside of plugin calls
+		constexpr std::uint32_t maxSlotsCount = 256;
+
+		struct alignas(64) Slot
+		{
+			std::atomic<std::int64_t> allocatedBytes;
+			std::atomic<std::int64_t> allocationsCount;
+		};
+
+		struct alignas(alignof(std::max_align_t)) Header
+		{
+			std::size_t size;
+			std::uint32_t slot;
+		};
+
+		inline Slot slots[maxSlotsCount] = {};
+		inline std::atomic<std::uint32_t> slotsCount = 1;
+		inline thread_local std::uint32_t currentSlot = 0;
+
+		//-------------------------------------------------------------------------------------------------------
+		// @returns new slot for a plugin, slot 0 if all of them are
+		//		already taken
+		inline std::uint32_t acquireSlot()
+		{
+			const std::uint32_t slot = slotsCount.fetch_add(1, std::memory_order_relaxed);
+			return slot < maxSlotsCount ? slot : 0;
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		// @returns memory attributed to the slot
+		// @param slot - slot returned by 'acquireSlot'
+		inline MemoryUsage getUsage(std::uint32_t slot)
+		{
+			MemoryUsage result;
+			result.allocatedBytes = static_cast<std::size_t>(std::max<std::int64_t>(0, slots[slot].allocatedBytes.load(std::memory_order_relaxed)));
+			result.allocationsCount = static_cast<std::size_t>(std::max<std::int64_t>(0, slots[slot].allocationsCount.load(std::memory_order_relaxed)));
+			return result;
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		// Used by the replaced operator new.
+		// @returns allocated block or nullptr if malloc failed
+		// @param size - requested size
+		inline void* allocate(std::size_t size) noexcept
+		{
+			Header* const header = static_cast<Header*>(std::malloc(sizeof(Header) + size));
+			if (!header)
+				return nullptr;
+
+			header->size = size;
+			header->slot = currentSlot;
+			slots[header->slot].allocatedBytes.fetch_add(static_cast<std::int64_t>(size), std::memory_order_relaxed);
+			slots[header->slot].allocationsCount.fetch_add(1, std::memory_order_relaxed);
+			return header + 1;
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		// Used by the replaced operator new.
+		// @returns allocated block, calls new handler until it succeeds
+		//		or throws std::bad_alloc
+		// @param size - requested size
+		inline void* allocateOrThrow(std::size_t size)
+		{
+			while (true)
+			{
+				if (void* const block = allocate(size))
+					return block;
+
+				const std::new_handler handler = std::get_new_handler();
+				if (!handler)
+					throw std::bad_alloc();
+				handler();
+			}
+		}
+
+		//-------------------------------------------------------------------------------------------------------
+		// Used by the replaced operator delete.
+		// @param block - block returned by 'allocate' or nullptr
+		inline void deallocate(void* block) noexcept
+		{
+			if (!block)
+				return;
+
+			Header* const header = static_cast<Header*>(block) - 1;
+			slots[header->slot].allocatedBytes.fetch_sub(static_cast<std::int64_t>(header->size), std::memory_order_relaxed);
+			slots[header->slot].allocationsCount.fetch_sub(1, std::memory_order_relaxed);
+			std::free(header);
+		}
+	} // namespace MemoryAccounting
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Usage statistics of a single plugin, collected by the Router if
+	// usage tracking is enabled (see Router::enableUsageTracking). The
+	// record outlives unloading of the plugin.
+	class PluginUsage final
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		PluginUsage() : m_memorySlot(MemoryAccounting::acquireSlot()), m_lastUseTime(Clock::now().time_since_epoch().count()) {}
+
+		// @returns time of the latest call of any handler or receiver
+		//		of the plugin or the time of its first registration if
+		//		none was called yet
+		Clock::time_point getLastUseTime() const { return Clock::time_point(Clock::duration(m_lastUseTime.load(std::memory_order_relaxed))); }
+
+		// @returns memory allocated by handlers and receivers of the
+		//		plugin that wasn't freed yet, zeros if the memory
+		//		accounting isn't installed
+		MemoryUsage getMemoryUsage() const { return MemoryAccounting::getUsage(m_memorySlot); }
+
+		//-------------------------------------------------------------------------------------------------------
+		// Marks the plugin as used and attributes allocations made by
+		// the current thread to it until the scope ends.
+		class Scope
+		{
+		public:
+			// @param usage - usage of the called plugin, does nothing
+			//		if it's null
+			Scope(PluginUsage* usage) : m_previousSlot(MemoryAccounting::currentSlot)
+			{
+				if (usage)
+				{
+					usage->m_lastUseTime.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+					MemoryAccounting::currentSlot = usage->m_memorySlot;
+				}
+			}
+			~Scope() { MemoryAccounting::currentSlot = m_previousSlot; }
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			std::uint32_t m_previousSlot;
+		};
+
+	private:
+		std::uint32_t m_memorySlot = 0;
+		std::atomic<Clock::rep> m_lastUseTime;
+	}; // class PluginUsage
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// When PluginsContainer::evictPlugins unloads plugins. Evicted
+	// plugins are loaded again as soon as any of their intents or
+	// events is dispatched.
+	class EvictionPolicy
+	{
+	public:
+		// plugins not used for at least this long are evicted, zero
+		// disables the limit
+		std::chrono::nanoseconds idleTimeout = std::chrono::nanoseconds::zero();
+
+		// if loaded plugins occupy more memory (mapped library plus
+		// allocations) the least recently used ones are evicted, zero
+		// disables the limit
+		std::size_t memoryBudget = 0;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Memory used by a plugin, see PluginsContainer::getMemoryReport.
+	class PluginMemoryReport
+	{
+	public:
+		std::string name;
+		bool isLoaded = false;
+		// size of the mapped shared library image, zero if it's
+		// evicted or linked into the executable
+		std::size_t mappedSize = 0;
+		// allocations made by handlers and receivers of the plugin
+		// that weren't freed yet
+		MemoryUsage allocated;
+		PluginUsage::Clock::time_point lastUseTime;
+	};
+
+} // namespace pp
+
+//-------------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------
+// Installs per-plugin memory accounting (see pp::MemoryAccounting).
+// Must be used exactly once, in a source file of the host executable.
+#define POLY_PLUGIN_MEMORY_ACCOUNTING()\
+	void* operator new(std::size_t size) { return ::pp::MemoryAccounting::allocateOrThrow(size); }\
+	void* operator new[](std::size_t size) { return ::pp::MemoryAccounting::allocateOrThrow(size); }\
+	void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return ::pp::MemoryAccounting::allocate(size); }\
+	void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return ::pp::MemoryAccounting::allocate(size); }\
+	void operator delete(void* block) noexcept { ::pp::MemoryAccounting::deallocate(block); }\
+	void operator delete[](void* block) noexcept { ::pp::MemoryAccounting::deallocate(block); }\
+	void operator delete(void* block, std::size_t) noexcept { ::pp::MemoryAccounting::deallocate(block); }\
+	void operator delete[](void* block, std::size_t) noexcept { ::pp::MemoryAccounting::deallocate(block); }\
+	void operator delete(void* block, const std::nothrow_t&) noexcept { ::pp::MemoryAccounting::deallocate(block); }\
+	void operator delete[](void* block, const std::nothrow_t&) noexcept { ::pp::MemoryAccounting::deallocate(block); }
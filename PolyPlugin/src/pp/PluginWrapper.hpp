@@ -1,17 +1,33 @@
 #pragma once
 
 #include <filesystem>
+#include <chrono>
+#include <vector>
+#include <cstdint>
 
 #include <pp/Defines.hpp>
+#include <pp/StartupReport.hpp>
+#include <pp/StaticPluginsRegistry.hpp>
 #include <pp/PluginsContainer.hpp>
 
+#if defined(__linux__)
+	#include <link.h>
+#endif
+
+#if !defined(_WIN32)
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
 namespace pp
 {
-	class IPlugin;
-	// Helper using statement to simplify usage of type of a function 
-	// that is loaded from the shared library and provides instance of
-	// IPlugin.
-	using PluginCreatorType = IPlugin* STDCALL_CAST ();
+	// Part of the shared library image mapped into the process memory.
+	class MemoryRegion
+	{
+	public:
+		const void* address = nullptr;
+		std::size_t size = 0;
+	};
 
 	class PluginWrapper final
 	{
@@ -20,62 +36,150 @@ namespace pp
 		PluginWrapper(PluginWrapper&& other) 
 			: PluginWrapper{ other.m_libHandle, other.m_functionPtr }
 		{ 
-			m_pluginEntry = other.m_pluginEntry;
+			m_path = std::move(other.m_path);
+			m_pluginEntry = std::move(other.m_pluginEntry);
 			other.m_libHandle = nullptr;
 			other.m_functionPtr = nullptr;
-			other.m_pluginEntry = nullptr;
 		}
 
 		PluginWrapper& operator=(PluginWrapper&& other)
 		{
 			m_libHandle = other.m_libHandle;
 			m_functionPtr = other.m_functionPtr;
-			m_pluginEntry = other.m_pluginEntry;
+			m_path = std::move(other.m_path);
+			m_pluginEntry = std::move(other.m_pluginEntry);
 			other.m_libHandle = nullptr;
 			other.m_functionPtr = nullptr;
-			other.m_pluginEntry = nullptr;
 			return *this;
 		}
 		
 		void operator()() 
 		{ 
 			if (!m_pluginEntry)
-				m_pluginEntry = std::shared_ptr<IPlugin>(m_functionPtr());
+				m_pluginEntry = std::unique_ptr<IPlugin>(m_functionPtr());
 		}
 
-		std::shared_ptr<IPlugin> operator->()
+		// Plugin instance is owned by this wrapper and PluginsContainer
+		// keeps the wrapper alive for as long as the plugin is loaded
+		// so plain pointer is enough and accessing the plugin doesn't
+		// touch any reference counter.
+		IPlugin* operator->() const { return m_pluginEntry.get(); }
+		IPlugin* get() const { return m_pluginEntry.get(); }
+
+		bool isValid() const { return m_functionPtr != nullptr; }
+
+		// @returns true if the plugin instance exists, false if it was 
+		//		evicted with 'unload'
+		bool isLoaded() const { return m_pluginEntry != nullptr; }
+
+		// Deletes the plugin instance and unloads its shared library. 
+		// The path is kept so the plugin can be created again with 
+		// 'reload'. Nothing may reference the plugin's code afterwards.
+		void unload();
+
+		// Loads the shared library again, if it was unloaded, and 
+		// creates a new plugin instance. The library may have changed
+		// meanwhile so the caller checks the version of the instance.
+		// @returns false if the library couldn't be loaded
+		bool reload();
+
+		// @returns path of the shared library this plugin was loaded from
+		const std::filesystem::path& getPath() const { return m_path; }
+
+		// @returns memory regions occupied by the loaded shared library
+		//		image, empty if the library isn't loaded or the platform
+		//		doesn't allow to query it
+		std::vector<MemoryRegion> getMappedRegions() const;
+
+		// @returns total size of the memory regions occupied by the 
+		//		loaded shared library image
+		std::size_t getMappedSize() const
 		{
-			return m_pluginEntry;
+			std::size_t result = 0;
+			for (const MemoryRegion& region : getMappedRegions())
+				result += region.size;
+			return result;
 		}
 
-		bool isValid() const { return m_functionPtr != nullptr; }
+		// Reads every page of the mapped library image so the OS maps
+		// them in now instead of during the first calls of the plugin.
+		// @returns number of prefaulted bytes
+		std::size_t prefault() const;
 
-		static PluginWrapper loadPluginEntryPoint(const std::filesystem::path& path)
+		// Locks the mapped library image in physical memory so its 
+		// pages aren't paged out while the plugin is idle. The lock is
+		// released when the library is unloaded. Usually needs extra 
+		// privileges (RLIMIT_MEMLOCK, working set size on Windows).
+		// @returns number of locked bytes, zero if it wasn't allowed
+		std::size_t lockPages() const;
+
+		// @returns wrapper of the entry point of a plugin linked into 
+		//		the executable, it's not backed by any shared library.
+		//		Its path contains the index of the entry since that's 
+		//		what identifies the plugin, names may repeat.
+		// @param entry - entry of StaticPluginsRegistry
+		// @param index - index of the entry in the registry
+		static PluginWrapper fromStaticEntryPoint(const StaticPluginsRegistry::Entry& entry, std::size_t index)
+		{
+			PluginWrapper wrapper(nullptr, entry.creator);
+			wrapper.m_path = std::filesystem::path("static") / std::to_string(index) / entry.name;
+			return wrapper;
+		}
+
+		// @returns wrapper of the plugin entry point loaded from the 
+		//		shared library, invalid wrapper if the library couldn't 
+		//		be loaded or it doesn't export 'createPolyPlugin'
+		// @param path - path to the shared library
+		// @param report - if not null the time of loading the library
+		//		and looking up the entry point is written there
+		static PluginWrapper loadPluginEntryPoint(const std::filesystem::path& path, PluginLoadReport* report = nullptr)
 		{
+			using Clock = std::chrono::steady_clock;
+			const Clock::time_point loadStart = Clock::now();
 #if defined(_WIN32)
 			HINSTANCE libHandle = LoadLibrary(LPCSTR(path.string().c_str()));
+			const Clock::time_point lookupStart = Clock::now();
+			if (report)
+				report->libraryLoadTime = lookupStart - loadStart;
 			if (!libHandle)
 				return PluginWrapper{ nullptr, nullptr };
 
 			void* pluginEntry = GetProcAddress(libHandle, "createPolyPlugin");
-			auto w = GetLastError();
+			if (report)
+				report->entryPointLookupTime = Clock::now() - lookupStart;
 			if (!pluginEntry)
+			{
+				FreeLibrary(libHandle);
+				if (report)
+					report->status = ePluginLoadStatus::ENTRY_POINT_MISSING;
 				return PluginWrapper{ nullptr, nullptr };
+			}
 
-			return PluginWrapper(libHandle, reinterpret_cast<PluginCreatorType>(pluginEntry));
+			PluginWrapper wrapper(libHandle, reinterpret_cast<PluginCreatorType>(pluginEntry));
+			wrapper.m_path = path;
+			return wrapper;
 #else 
 			void* libHandle = dlopen(path.string().c_str(), RTLD_NOW);
+			const Clock::time_point lookupStart = Clock::now();
+			if (report)
+				report->libraryLoadTime = lookupStart - loadStart;
 			if (const char* err = dlerror())
 				return PluginWrapper{ nullptr, nullptr };
 
 			void* pluginEntry = dlsym(libHandle, "createPolyPlugin");
+			if (report)
+				report->entryPointLookupTime = Clock::now() - lookupStart;
 			if (const char* err = dlerror())
 			{
 				dlclose(libHandle);
+				if (report)
+					report->status = ePluginLoadStatus::ENTRY_POINT_MISSING;
 				return PluginWrapper{ nullptr, nullptr };
 			}
 
-			return PluginWrapper(libHandle, reinterpret_cast<PluginCreatorType>(pluginEntry));
+			PluginWrapper wrapper(libHandle, reinterpret_cast<PluginCreatorType>(pluginEntry));
+			wrapper.m_path = path;
+			return wrapper;
 #endif
 		}
 
@@ -106,7 +210,136 @@ namespace pp
 #endif
 		
 		PluginCreatorType m_functionPtr = nullptr;
-		std::shared_ptr<IPlugin> m_pluginEntry = nullptr;
+		std::filesystem::path m_path;
+		std::unique_ptr<IPlugin> m_pluginEntry = nullptr;
 	};
 
+	//-------------------------------------------------------------------------------------------------------
+	inline void PluginWrapper::unload()
+	{
+		m_pluginEntry = nullptr;
+
+		// plugins linked into the executable keep their entry point
+		if (!m_libHandle)
+			return;
+
+#if defined(_WIN32)
+		FreeLibrary(m_libHandle);
+#else
+		dlclose(m_libHandle);
+#endif
+		m_libHandle = nullptr;
+		m_functionPtr = nullptr;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool PluginWrapper::reload()
+	{
+		if (!m_functionPtr)
+		{
+			PluginWrapper loaded = loadPluginEntryPoint(m_path);
+			if (!loaded.isValid())
+				return false;
+
+			std::swap(m_libHandle, loaded.m_libHandle);
+			std::swap(m_functionPtr, loaded.m_functionPtr);
+		}
+
+		(*this)();
+		return isLoaded();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::size_t PluginWrapper::prefault() const
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		const std::size_t pageSize = systemInfo.dwPageSize;
+#else
+		const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+
+		std::size_t result = 0;
+		for (const MemoryRegion& region : getMappedRegions())
+		{
+			if (region.size == 0)
+				continue;
+
+			// volatile reads can't be optimized away, the last byte is
+			// read separately because the region may end in the middle
+			// of a page that the stride would skip
+			const volatile unsigned char* const bytes = static_cast<const volatile unsigned char*>(region.address);
+			for (std::size_t offset = 0; offset < region.size; offset += pageSize)
+				(void)bytes[offset];
+			(void)bytes[region.size - 1];
+			result += region.size;
+		}
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::size_t PluginWrapper::lockPages() const
+	{
+		std::size_t result = 0;
+		for (const MemoryRegion& region : getMappedRegions())
+		{
+#if defined(_WIN32)
+			if (VirtualLock(const_cast<void*>(region.address), region.size))
+				result += region.size;
+#else
+			// POSIX requires the address to be page aligned
+			const std::uintptr_t pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+			const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(region.address);
+			const std::uintptr_t alignedAddress = address - address % pageSize;
+			if (mlock(reinterpret_cast<const void*>(alignedAddress), region.size + (address - alignedAddress)) == 0)
+				result += region.size;
+#endif
+		}
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::vector<MemoryRegion> PluginWrapper::getMappedRegions() const
+	{
+		if (!m_libHandle)
+			return {};
+
+#if defined(_WIN32)
+		// the module handle is the address of the image so its size
+		// can be read from its PE header
+		const auto dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(m_libHandle);
+		const auto ntHeaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(reinterpret_cast<const BYTE*>(m_libHandle) + dosHeader->e_lfanew);
+		return { MemoryRegion{ m_libHandle, ntHeaders->OptionalHeader.SizeOfImage } };
+#elif defined(__linux__)
+		link_map* linkMap = nullptr;
+		if (dlinfo(m_libHandle, RTLD_DI_LINKMAP, &linkMap) != 0 || !linkMap)
+			return {};
+
+		struct Query
+		{
+			ElfW(Addr) baseAddress;
+			std::vector<MemoryRegion> regions;
+		} query{ linkMap->l_addr, {} };
+
+		dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* data)
+		{
+			Query& query = *static_cast<Query*>(data);
+			if (info->dlpi_addr != query.baseAddress)
+				return 0;
+
+			for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i)
+			{
+				const ElfW(Phdr)& header = info->dlpi_phdr[i];
+				if (header.p_type == PT_LOAD)
+					query.regions.push_back({ reinterpret_cast<const void*>(info->dlpi_addr + header.p_vaddr), header.p_memsz });
+			}
+			return 1;
+		}, &query);
+
+		return query.regions;
+#else
+		return {};
+#endif
+	}
 }
\ No newline at end of file
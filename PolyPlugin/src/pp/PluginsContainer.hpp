@@ -1,15 +1,35 @@
 #pragma once
 
+#include <algorithm>
+
 #include <CmakeConfig.hpp>
 
 #include <pp/Defines.hpp>
 #include <pp/Router.hpp>
+#include <pp/PluginUsage.hpp>
+#include <pp/StartupReport.hpp>
+#include <pp/StaticPluginsRegistry.hpp>
 #include <pp/PluginsLoader.hpp>
 
 namespace pp
 {
 	class IPlugin;
 
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// What PluginsContainer::warmUp does with every loaded plugin.
+	class WarmUpOptions
+	{
+	public:
+		// touch all pages of the library image
+		bool prefault = true;
+		// lock the library image in physical memory
+		bool lockPages = false;
+		// call IPlugin::warmUp
+		bool callHook = true;
+	};
+
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
@@ -51,14 +71,77 @@ namespace pp
 		//		also all recursive subdirectories
 		std::vector<std::weak_ptr<PluginWrapper>> load(std::filesystem::path root, bool recursive);
 
+		// @returns collection of plugins linked directly into the 
+		//		executable (built with PP_STATIC_PLUGIN, see 
+		//		StaticPluginsRegistry). They go through the same version
+		//		check and initialization as plugins loaded by 'load' and
+		//		both kinds can be mixed. Only the first call creates 
+		//		the plugins, subsequent calls return empty collection.
+		std::vector<std::weak_ptr<PluginWrapper>> loadStatic();
+
 		// @returns intent router. Returned router is used to 
 		//		initialize all plugins that were loaded or will be 
-		//		loaded
+		//		loaded. It outlives all of the plugins so they may keep
+		//		plain references to it.
 		const std::shared_ptr<Router>& getRouter() const { return m_Router; }
 
+		// @returns timings of all phases of loading every plugin found
+		//		by 'load' calls so far
+		const StartupReport& getStartupReport() const { return m_startupReport; }
+
+		// Prepares plugins loaded since the previous call for serving
+		// traffic so their first dispatches aren't slower than the 
+		// following ones: pages of their libraries are prefaulted 
+		// (and optionally locked) and then IPlugin::warmUp of every 
+		// plugin is called in loading order. It's meant to be called
+		// once all plugins are loaded since warm-up hooks may dispatch
+		// intents to the other plugins. Times are 
+		// added to the startup report, Router::getLatencyReport shows
+		// the remaining difference between the first and later calls.
+		// @returns number of warmed up plugins
+		// @param options - which warm-up steps are done
+		std::size_t warmUp(const WarmUpOptions& options = {});
+
+		// Evicts plugins according to the policy: they're 
+		// deinitialized, deleted and their libraries are unloaded. An
+		// evicted plugin is loaded and initialized again on the thread
+		// that dispatches any of its intents or events. Plugins 
+		// without handlers and receivers are never evicted. Requires
+		// Router::enableUsageTracking before loading the plugins, must
+		// not be called while intents or events are dispatched.
+		// @returns number of evicted plugins
+		// @param policy - idle time and memory limits
+		std::size_t evictPlugins(const EvictionPolicy& policy);
+
+		// @returns memory used by all plugins (mapped library and 
+		//		allocations of their handlers) including evicted ones
+		std::vector<PluginMemoryReport> getMemoryReport() const;
+
+		// @returns names of evicted plugins that couldn't be loaded 
+		//		again, their library is gone or was replaced by one 
+		//		built with incompatible PolyPlugin version. Their 
+		//		intents and events are dispatched without them.
+		std::vector<std::string> getFailedReloads() const
+		{
+			std::lock_guard<std::mutex> lock(m_failedReloadsMutex);
+			return m_failedReloads;
+		}
+
 	private:
+		// Checks version of created plugins and initializes the 
+		// matching ones.
+		// @returns initialized plugins
+		std::vector<std::weak_ptr<PluginWrapper>> initPlugins(std::vector<std::shared_ptr<PluginWrapper>> plugins);
+
 		std::vector<std::shared_ptr<PluginWrapper>> m_plugins;
+		StartupReport m_startupReport;
+		std::size_t m_warmedUpPluginsCount = 0;
+		bool m_staticPluginsLoaded = false;
 		std::shared_ptr<Router> m_Router;
+
+		// reloads happen on dispatching threads
+		mutable std::mutex m_failedReloadsMutex;
+		std::vector<std::string> m_failedReloads;
 	}; // class PluginsContainer
 
 	//-------------------------------------------------------------------------------------------------------
@@ -80,8 +163,11 @@ namespace pp
 		// and the plugin is created. This is the place where the library 
 		// should register its intent handlers.
 		// @param router - plugin should register its intent handlers 
-		//		in this router.
-		virtual void init(std::shared_ptr<Router> router) = 0;
+		//		in this router. The router is guaranteed to be valid 
+		//		until 'deinit' returns so plugins and their handlers may 
+		//		keep a reference to it and dispatch intents without 
+		//		touching any reference counter.
+		virtual void init(Router& router) = 0;
 		// Called just before the plugin object is deleted and the 
 		// whole shared library is unloaded. This is the place for 
 		// cleanups and dispatching intents informing desired users 
@@ -92,12 +178,23 @@ namespace pp
 		//		this. The main purpose of this param is to allow plugin
 		//		to dispatch messages to other plugins that may be 
 		//		concerned about the lifetime of this plugin.
-		virtual void deinit(std::shared_ptr<Router> router) = 0;
+		virtual void deinit(Router& router) = 0;
 
 		// Plugin name and version are only for display purposes and 
 		// might be useful for other ISelector implementation.
 		virtual PluginInfo getPluginInfo() const = 0;
 
+		// Called by PluginsContainer::warmUp before the host starts 
+		// dispatching. All plugins are initialized and the libraries 
+		// of the plugins being warmed up are prefaulted by then, the
+		// hooks are called in loading order so a hook dispatching to 
+		// plugins loaded later reaches them before their own hooks.
+		// This is the place for lazy initialization and for 
+		// dispatching a few representative intents so the first real
+		// ones don't pay for cold caches.
+		// @param router - the same router that was passed to 'init'
+		virtual void warmUp(Router& /*router*/) { }
+
 		// This is the PolyPlugin version used by this plugin. If the major 
 		// version differs from the one saved in PluginsContainer which 
 		// loads this plugin this plugin will be ignored and deleted 
@@ -109,8 +206,19 @@ namespace pp
 	}; // class IPlugin
 
 	//-------------------------------------------------------------------------------------------------------
-	PluginsContainer::~PluginsContainer()
+	inline PluginsContainer::~PluginsContainer()
 	{
+		// plugins are deinitialized in reverse order of loading while
+		// the router is still alive
+		for (auto it = m_plugins.rbegin(); it != m_plugins.rend(); ++it)
+		{
+			PluginWrapper& plugin = **it;
+			const PluginLoadReport* report = m_startupReport.find(plugin.getPath());
+			if (plugin.isLoaded())
+				plugin->deinit(*m_Router);
+			m_Router->unregisterPlugin(report->name);
+		}
+
 		assert(m_Router.use_count() == 1);
 		for (const std::shared_ptr<PluginWrapper>& plugin : m_plugins)
 			assert(plugin.use_count() == 1);
@@ -119,16 +227,176 @@ namespace pp
 	//-------------------------------------------------------------------------------------------------------
 	inline std::vector<std::weak_ptr<PluginWrapper>> pp::PluginsContainer::load(std::filesystem::path root, bool recursive)
 	{
+		return initPlugins(PluginsLoader::loadPlugins(std::move(root), recursive, &m_startupReport));
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::vector<std::weak_ptr<PluginWrapper>> PluginsContainer::loadStatic()
+	{
+		if (m_staticPluginsLoaded)
+			return {};
+
+		m_staticPluginsLoaded = true;
+		return initPlugins(PluginsLoader::loadStaticPlugins(&m_startupReport));
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::size_t PluginsContainer::warmUp(const WarmUpOptions& options)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		std::vector<std::pair<PluginWrapper*, PluginLoadReport*>> plugins;
+		for (; m_warmedUpPluginsCount < m_plugins.size(); ++m_warmedUpPluginsCount)
+		{
+			PluginWrapper& plugin = *m_plugins[m_warmedUpPluginsCount];
+			if (plugin.isLoaded())
+				plugins.emplace_back(&plugin, m_startupReport.find(plugin.getPath()));
+		}
+
+		// all pages are in before any hook runs since hooks may 
+		// dispatch to the other plugins
+		for (const auto& [plugin, report] : plugins)
+		{
+			const Clock::time_point warmUpStart = Clock::now();
+			if (options.prefault)
+				report->prefaultedSize = plugin->prefault();
+			if (options.lockPages)
+				report->lockedSize = plugin->lockPages();
+			report->warmUpTime = Clock::now() - warmUpStart;
+		}
+
+		if (options.callHook)
+			for (const auto& [plugin, report] : plugins)
+			{
+				const Clock::time_point hookStart = Clock::now();
+				(*plugin)->warmUp(*m_Router);
+				report->warmUpTime += Clock::now() - hookStart;
+			}
+
+		return plugins.size();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::size_t PluginsContainer::evictPlugins(const EvictionPolicy& policy)
+	{
+		const PluginUsage::Clock::time_point now = PluginUsage::Clock::now();
+
+		std::vector<PluginMemoryReport> loaded;
+		std::size_t loadedSize = 0;
+		for (const PluginMemoryReport& plugin : getMemoryReport())
+			if (plugin.isLoaded)
+			{
+				loadedSize += plugin.mappedSize + plugin.allocated.allocatedBytes;
+				loaded.push_back(plugin);
+			}
+
+		// the least recently used plugins go first
+		std::sort(loaded.begin(), loaded.end(), [](const PluginMemoryReport& left, const PluginMemoryReport& right)
+		{
+			return left.lastUseTime < right.lastUseTime;
+		});
+
+		std::size_t result = 0;
+		for (const PluginMemoryReport& candidate : loaded)
+		{
+			const bool isIdle = policy.idleTimeout > std::chrono::nanoseconds::zero() && now - candidate.lastUseTime >= policy.idleTimeout;
+			const bool isOverBudget = policy.memoryBudget > 0 && loadedSize > policy.memoryBudget;
+			if (!isIdle && !isOverBudget)
+				continue;
+
+			const auto it = std::find_if(m_plugins.begin(), m_plugins.end(), [&](const std::shared_ptr<PluginWrapper>& plugin)
+			{
+				return plugin->isLoaded() && m_startupReport.find(plugin->getPath())->name == candidate.name;
+			});
+			if (it == m_plugins.end())
+				continue;
+
+			const std::shared_ptr<PluginWrapper>& plugin = *it;
+			const std::weak_ptr<PluginWrapper> weakPlugin = plugin;
+			const bool isSuspended = m_Router->suspendPlugin(candidate.name, 
+				[&plugin](Router& router) { (*plugin)->deinit(router); },
+				[this, weakPlugin, name = candidate.name](Router& router)
+				{
+					const std::shared_ptr<PluginWrapper> plugin = weakPlugin.lock();
+					if (!plugin)
+						return;
+
+					// the library may have been replaced since the plugin 
+					// was evicted so it goes through the same check as 
+					// during loading
+					if (plugin->reload() && (*plugin)->usedPolyPluginVersion.major == polyPluginVersion.major)
+					{
+						(*plugin)->init(router);
+						return;
+					}
+
+					plugin->unload();
+					std::lock_guard<std::mutex> lock(m_failedReloadsMutex);
+					m_failedReloads.push_back(name);
+				});
+			if (!isSuspended)
+				continue;
+
+			plugin->unload();
+			loadedSize -= std::min(loadedSize, candidate.mappedSize + candidate.allocated.allocatedBytes);
+			++result;
+		}
+
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::vector<PluginMemoryReport> PluginsContainer::getMemoryReport() const
+	{
+		std::vector<PluginMemoryReport> result;
+		for (const std::shared_ptr<PluginWrapper>& plugin : m_plugins)
+		{
+			PluginMemoryReport report;
+			report.name = m_startupReport.find(plugin->getPath())->name;
+			report.isLoaded = plugin->isLoaded();
+			report.mappedSize = plugin->getMappedSize();
+			if (const std::shared_ptr<const PluginUsage> usage = m_Router->getPluginUsage(report.name))
+			{
+				report.allocated = usage->getMemoryUsage();
+				report.lastUseTime = usage->getLastUseTime();
+			}
+			result.push_back(std::move(report));
+		}
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::vector<std::weak_ptr<PluginWrapper>> PluginsContainer::initPlugins(std::vector<std::shared_ptr<PluginWrapper>> plugins)
+	{
+		using Clock = std::chrono::steady_clock;
 		std::vector<std::weak_ptr<PluginWrapper>> result;
 
-		for (std::shared_ptr<PluginWrapper> plugin : PluginsLoader::loadPlugins(std::move(root), recursive))
+		for (std::shared_ptr<PluginWrapper> plugin : plugins)
 		{
+			PluginLoadReport* report = m_startupReport.find(plugin->getPath());
+
+			// the layout of an incompatible plugin is unknown so nothing
+			// but the version is read from it
 			if ((*plugin)->usedPolyPluginVersion.major == polyPluginVersion.major)
 			{
-				(*plugin)->init(m_Router);
+				const PluginInfo info = (*plugin)->getPluginInfo();
+				report->name = info.name;
+				report->version = info.version;
+
+				const std::size_t handlersCount = m_Router->getHandlersCount();
+				const std::size_t receiversCount = m_Router->getReceiversCount();
+				const Clock::time_point initStart = Clock::now();
+				(*plugin)->init(*m_Router);
+				report->initTime = Clock::now() - initStart;
+				report->handlersCount = m_Router->getHandlersCount() - handlersCount;
+				report->receiversCount = m_Router->getReceiversCount() - receiversCount;
+				report->status = ePluginLoadStatus::INITIALIZED;
+
 				result.push_back(plugin);
 				m_plugins.push_back(std::move(plugin));
 			}
+			else
+				report->status = ePluginLoadStatus::VERSION_MISMATCH;
 		}
 
 		return result;
@@ -142,8 +410,20 @@ namespace pp
 // Helper macro for library users. It is declaration of method that 
 // needs to be exported from shared library so PolyPlugin will be 
 // able to load IPlugin instance form there.
-#define POLY_PLUGIN_ENTRY(PluginName)\
+// If PP_STATIC_PLUGIN is defined the plugin is meant to be linked 
+// directly into the host executable so instead of exporting the 
+// symbol it registers itself in StaticPluginsRegistry.
+#if defined(PP_STATIC_PLUGIN)
+	#define POLY_PLUGIN_ENTRY(PluginName)\
+		static ::pp::IPlugin* STDCALL createStatic##PluginName()\
+		{\
+			return new PluginName();\
+		}\
+		static const bool isStatic##PluginName##Registered = ::pp::StaticPluginsRegistry::add(#PluginName, &createStatic##PluginName);
+#else
+	#define POLY_PLUGIN_ENTRY(PluginName)\
 		extern "C" PP_EXPORT ::pp::IPlugin* STDCALL createPolyPlugin()\
 		{\
 			return new PluginName();\
 		}
+#endif
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <filesystem>
+#include <chrono>
 
 #include <pp/Defines.hpp>
+#include <pp/StartupReport.hpp>
 #include <pp/PluginWrapper.hpp>
 
 namespace pp
@@ -12,7 +14,7 @@ namespace pp
 		//-------------------------------------------------------------------------------------------------------
 		// @returns true if it is a plugin type, false otherwise.
 		// @param path - path to the file being checked
-		bool isPlugin(const std::filesystem::path& path)
+		inline bool isPlugin(const std::filesystem::path& path)
 		{
 		#if defined(_WIN32)
 			return path.extension() == ".dll";
@@ -31,7 +33,7 @@ namespace pp
 		// @param recursive - if this param is true then this method will 
 		//		return shared libraries from not only the given directory but 
 		//		also all recursive subdirectories
-		std::vector<std::filesystem::path> getAllSharedLibs(std::filesystem::path path, bool recursive)
+		inline std::vector<std::filesystem::path> getAllSharedLibs(std::filesystem::path path, bool recursive)
 		{
 			if (!std::filesystem::exists(path))
 				return {};
@@ -83,18 +85,66 @@ namespace pp
 		// @param recursive - if this param is true then this method will 
 		//		return shared libraries from not only the given directory but 
 		//		also all recursive subdirectories
-		std::vector<std::shared_ptr<PluginWrapper>> loadPlugins(std::filesystem::path root, bool recursive)
+		// @param report - if not null the directory scan time and the 
+		//		timings of every found library are appended there
+		inline std::vector<std::shared_ptr<PluginWrapper>> loadPlugins(std::filesystem::path root, bool recursive, StartupReport* report = nullptr)
 		{
+			using Clock = std::chrono::steady_clock;
 			std::vector<std::shared_ptr<PluginWrapper>> result;
 
-			for (const std::filesystem::path& path : getAllSharedLibs(root, recursive))
+			const Clock::time_point scanStart = Clock::now();
+			const std::vector<std::filesystem::path> paths = getAllSharedLibs(root, recursive);
+			if (report)
+				report->scanTime += Clock::now() - scanStart;
+
+			for (const std::filesystem::path& path : paths)
 			{
-				PluginWrapper wrapper = PluginWrapper::loadPluginEntryPoint(path);
-				if (!wrapper.isValid())
-					continue;
+				PluginLoadReport pluginReport;
+				pluginReport.path = path;
+
+				PluginWrapper wrapper = PluginWrapper::loadPluginEntryPoint(path, report ? &pluginReport : nullptr);
+				if (wrapper.isValid())
+				{
+					const Clock::time_point createStart = Clock::now();
+					wrapper();
+					pluginReport.createTime = Clock::now() - createStart;
+					pluginReport.mappedSize = report ? wrapper.getMappedSize() : 0;
+					result.push_back(std::make_shared<PluginWrapper>(std::move(wrapper)));
+				}
+
+				if (report)
+					report->plugins.push_back(std::move(pluginReport));
+			}
+
+			return result;
+		}
 
+		//-------------------------------------------------------------------------------------------------------
+		// @returns collection of plugins linked into the executable 
+		//		(see StaticPluginsRegistry), created but not initialized
+		//		yet just like the ones returned by 'loadPlugins'.
+		// @param report - if not null the timings of every created 
+		//		plugin are appended there
+		inline std::vector<std::shared_ptr<PluginWrapper>> loadStaticPlugins(StartupReport* report = nullptr)
+		{
+			using Clock = std::chrono::steady_clock;
+			std::vector<std::shared_ptr<PluginWrapper>> result;
+
+			const std::vector<StaticPluginsRegistry::Entry>& entries = StaticPluginsRegistry::getEntries();
+			for (std::size_t i = 0; i < entries.size(); ++i)
+			{
+				PluginWrapper wrapper = PluginWrapper::fromStaticEntryPoint(entries[i], i);
+
+				PluginLoadReport pluginReport;
+				pluginReport.path = wrapper.getPath();
+
+				const Clock::time_point createStart = Clock::now();
 				wrapper();
+				pluginReport.createTime = Clock::now() - createStart;
 				result.push_back(std::make_shared<PluginWrapper>(std::move(wrapper)));
+
+				if (report)
+					report->plugins.push_back(std::move(pluginReport));
 			}
 
 			return result;
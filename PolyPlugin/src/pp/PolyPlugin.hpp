@@ -33,13 +33,13 @@ Example plugin:
 	class Plugin : public pp::IPlugin
 	{
 	public:
-		void init(std::shared_ptr<pp::Router> router) final
+		void init(pp::Router& router) final
 		{
-			router->registerReceiver<AddIntent>(getPluginInfo(), 
+			router.registerIntentHandler<AddIntent>(getPluginInfo(), 
 				[this] (AddIntent intent) { return addIntentReceiver(std::move(intent)); });
 		}
 
-		void deinit(std::shared_ptr<pp::Router> router) final { }
+		void deinit(pp::Router&) final { }
 		const pp::PluginInfo& getPluginInfo() const final { return { "Calculator", { 1, 0, 0} }; }
 
 	private:
@@ -47,10 +47,21 @@ Example plugin:
 	};
 
 	//-------------------------------------------------------------------------------------------------------
-	POLY_PLUGIN_ENTRY() { return new Plugin(); }
+	POLY_PLUGIN_ENTRY(Plugin)
 
 This example shows a plugin that supports processing of 'AddIntent' intent.
 
+The same plugin can be linked directly into the host executable. If 
+its sources are compiled with PP_STATIC_PLUGIN defined (e.g. as a CMake
+OBJECT library linked to the host) POLY_PLUGIN_ENTRY registers the 
+plugin in StaticPluginsRegistry instead of exporting 'createPolyPlugin'
+and PluginsContainer::loadStatic creates and initializes it like a 
+dynamically loaded one. Static plugins are identified by their index 
+in the registry (their startup report path is "static/<index>/<class>")
+so plugin classes with the same name in unnamed namespaces of 
+different source files don't alias. Registering the same entry point
+twice is rejected.
+
 
 
 #######################################################################
@@ -85,4 +96,280 @@ Example intent:
 		int b = 0;
 	};
 
+Intents whose result depends only on their fields may also provide 
+a static 'cacheKey' function returning a hashable key. Results of such
+intents are cached by the Router (bounded, sharded LRU cache) and
+repeated intents don't call the handler at all:
+
+	static std::uint64_t cacheKey(const AddIntent& intent) { ... }
+
+The cache is invalidated whenever handlers of the intent are 
+registered or removed and when the selector chooses another handler.
+Router::getIntentCacheStats shows hits and misses.
+
+
+
+#######################################################################
+### Startup report
+#######################################################################
+
+PluginsContainer measures every phase of loading every plugin: 
+loading the library (including its relocations and static 
+initializers), looking up the entry point, creating the plugin and 
+initializing it. The report also contains the status of libraries that
+couldn't be loaded, the mapped size of every library and the number of
+handlers and receivers every plugin registered:
+
+	container.load(path, false);
+	const pp::StartupReport& report = container.getStartupReport();
+	for (const pp::PluginLoadReport& plugin : report.plugins)
+		std::cout << plugin.name << ": " << plugin.getTotalTime().count() << " ns" << std::endl;
+
+	report.saveJson("startup.json"); // or report.toJson()
+
+Times of warming up plugins (see below) are added to the same report.
+
+
+
+#######################################################################
+### Warming up plugins
+#######################################################################
+
+The first dispatch to a freshly loaded plugin is usually much slower 
+than the following ones: pages of its library are faulted in, caches 
+are cold and handlers initialize their state lazily. Hosts that must
+be at full speed before taking traffic can warm the plugins up once 
+all of them are loaded:
+
+	container.getRouter()->setLatencyTracking(true);
+	container.load(path, false);
+	container.warmUp(pp::WarmUpOptions{ true, true, true }); // prefault, lock, hook
+	...
+	std::vector<pp::HandlerLatencyReport> report = container.getRouter()->getLatencyReport();
+
+Plugins may override IPlugin::warmUp to initialize their state or to 
+dispatch a few representative intents. The hooks are called in loading
+order once the libraries of all warmed up plugins are prefaulted, so a
+hook may reach plugins whose own hooks didn't run yet. The latency 
+report compares the first call of every handler with its steady 
+state, the startup report contains time spent on warming up every 
+plugin.
+
+
+
+#######################################################################
+### Dispatching with a deadline
+#######################################################################
+
+If several plugins handle the same intent it can be dispatched with a
+latency budget:
+
+	pp::DispatchResult<AddIntent::Result> result = 
+		router.processIntentWithin(AddIntent{ 2, 3 }, std::chrono::milliseconds(5));
+
+If the selected handler doesn't finish in time or throws 
+pp::HandlerOverloaded the next handler from Selector::rankHandlers is
+started. The result status is TIMEOUT if none of them made it. The
+Router tracks recent latency of every handler so a selector (e.g. 
+pp::FastestHandlerSelector) can prefer faster implementations:
+
+	auto router = std::make_shared<pp::Router>(nullptr, threadPool); // default selector until replaced
+	router->setSelector(std::make_shared<pp::FastestHandlerSelector>(*router));
+
+Handlers are abandoned only if the Router has a thread pool, without
+one they are called on the dispatching thread one after another.
+
+
+
+#######################################################################
+### Events and receivers ordering
+#######################################################################
+
+Events are dispatched to all receivers chosen by the selector. If some
+receivers depend on side effects of the others they can declare it 
+when registering:
+
+	router.registerEventReceiver<FrameEvent>(getPluginInfo(), receiver, 
+		pp::ReceiverOrder{ { "Physics" }, {} }); // after "Physics"
+
+The dependency graph is built once per event type during 
+registration. If the Router was created with a ThreadPool independent
+receivers are executed concurrently and the constraints are still 
+honored. Constraints closing a cycle with the ones registered earlier
+are ignored, Router::getIgnoredReceiverConstraints lists them.
+
+Receivers may also have a priority, higher priority receivers are 
+called first. Receivers are kept sorted at registration so the 
+dispatch doesn't sort anything:
+
+	router.registerEventReceiver<KeyEvent>(getPluginInfo(), receiver, 
+		pp::ReceiverOrder{ {}, {}, 10 });
+
+Events handled by the first interested receiver (e.g. input) can let
+receivers consume them. Such events provide a static function telling
+which results stop the propagation, receivers of these events are 
+called one by one and the rest is skipped once the event is consumed:
+
+	class KeyEvent
+	{
+	public:
+		using Result = bool; // true if consumed
+		static inline pp::EventInfo Info = { "KeyEvent", 1 };
+		static bool stopsPropagation(bool consumed) { return consumed; }
+
+		int key = 0;
+	};
+
+
+
+#######################################################################
+### Posting and coalescing events
+#######################################################################
+
+Events can also be posted with Router::postEvent and dispatched later,
+all at once, with Router::dispatchPostedEvents (e.g. once per frame).
+Event types that are emitted many times within such window may opt 
+into coalescing so the receivers get only one event per key:
+
+	class EntityMovedEvent
+	{
+	public:
+		using Result = bool;
+		static inline pp::EventInfo Info = { "EntityMovedEvent", 1 };
+
+		// required, events with equal keys are collapsed
+		static int coalescingKey(const EntityMovedEvent& event) { return event.entity; }
+		// optional, without it the latest event wins
+		static void coalesce(EntityMovedEvent& pending, EntityMovedEvent&& incoming) { ... }
+
+		int entity = 0;
+	};
+
+Router::getCoalescingStats shows how many receiver calls were saved.
+
+
+
+#######################################################################
+### Large payloads
+#######################################################################
+
+Intents and events carrying big blobs (images, meshes, documents) can
+reference an immutable, reference counted pp::Payload instead of owning
+the bytes. Copying the intent or passing the event to many receivers 
+copies only the reference and receivers may keep the payload after 
+they return. Buffers come from power of 2 size classes of a pool and
+go back to its free lists when the last reference is dropped:
+
+	class ImageLoadedEvent
+	{
+	public:
+		using Result = bool;
+		static inline pp::EventInfo Info = { "ImageLoadedEvent", 1 };
+
+		pp::Payload pixels;
+	};
+
+	pp::PayloadWriter writer = router.getPayloadPool().acquire(size);
+	decode(file, writer.data());
+	router.processEvent(ImageLoadedEvent{ std::move(writer).freeze() });
+
+The Router owns one pool shared by all plugins, others can be created
+with their own pp::PayloadPoolOptions.
+
+
+
+#######################################################################
+### Actor execution
+#######################################################################
+
+Plugins with mutable state usually have to guard it with locks if 
+intents and events are dispatched from several threads. Instead the 
+Router can run every plugin as an actor:
+
+	pp::Router router;
+	router.enableActorExecution(pp::ActorOptions{ true, 0 }); // pinned
+
+Every plugin gets a mailbox with a dedicated worker thread and its 
+handlers and receivers are always called on that thread, one message
+at a time. processIntent waits for the result, a handler calling 
+another plugin keeps processing its own mailbox in the meantime so 
+plugins may call each other. Other handlers of the calling plugin may
+therefore run while it waits, on the same thread, so state read before
+such a call may be stale after it. Plugin init and deinit still run on
+the thread that loads the plugins. enableActorExecution throws 
+std::logic_error once any plugin has registered.
+
+
+
+#######################################################################
+### Sharded intent handlers
+#######################################################################
+
+A stateful handler (per session, per entity) processes one intent at a
+time. If the state can be partitioned the intent may provide a key:
+
+	class SessionIntent
+	{
+	public:
+		using Result = Response;
+		static inline pp::IntentInfo Info = { "SessionIntent", 1 };
+		static std::uint64_t partitionKey(const SessionIntent& intent) { return intent.sessionId; }
+
+		std::uint64_t sessionId = 0;
+		Request request;
+	};
+
+and the plugin registers a family of handler instances, each running 
+on its own mailbox thread:
+
+	router.registerShardedIntentHandler<SessionIntent>(getPluginInfo(), 
+		std::thread::hardware_concurrency(), [this](std::size_t shard)
+		{
+			return [state = &m_shards[shard]](SessionIntent intent) { return state->process(intent); };
+		});
+
+std::thread::hardware_concurrency() may return 0 if the number of cores
+isn't known; a shards count of 0 is clamped to 1.
+
+Intents are routed to shards by consistent hashing of the key, so all
+intents of one session are processed by the same shard and different 
+sessions are processed in parallel. Intents of one session keep the 
+order of dispatching only if they're dispatched from a single thread;
+intents dispatched concurrently are processed in the order they reach
+the shard. Workers of the shards are stopped when the plugin is 
+unregistered or suspended, before its library is unloaded.
+
+
+
+#######################################################################
+### Memory accounting and evicting idle plugins
+#######################################################################
+
+With usage tracking enabled the Router remembers when every plugin was
+used for the last time. If the host also installs the accounting 
+operators (in exactly one of its source files) allocations made by 
+handlers and receivers are attributed to their plugins:
+
+	POLY_PLUGIN_MEMORY_ACCOUNTING()
+
+	pp::PluginsContainer container;
+	container.getRouter()->enableUsageTracking(); // before loading
+	container.load(path, false);
+	...
+	std::vector<pp::PluginMemoryReport> report = container.getMemoryReport();
+
+Plugins that are idle or don't fit into a memory budget can be 
+evicted between dispatches. They are deinitialized and their 
+libraries are unloaded. The next dispatch of any of their intents or
+events loads and initializes them again, their handlers get their 
+original indices back:
+
+	pp::EvictionPolicy policy;
+	policy.idleTimeout = std::chrono::minutes(10);
+	container.evictPlugins(policy);
+
+The reload happens on the dispatching thread. If the library is gone
+or its PolyPlugin version doesn't match anymore the plugin stays 
+unloaded and PluginsContainer::getFailedReloads lists it.
+
 */
\ No newline at end of file
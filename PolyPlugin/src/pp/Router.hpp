@@ -5,13 +5,43 @@
 #include <map>
 #include <cassert>
 #include <numeric>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <type_traits>
+#include <condition_variable>
 
 #include <pp/FunctionsCollection.hpp>
+#include <pp/EventQueue.hpp>
+#include <pp/DeadlineDispatch.hpp>
+#include <pp/ThreadPool.hpp>
+#include <pp/Mailbox.hpp>
+#include <pp/PayloadPool.hpp>
+#include <pp/ShardedHandler.hpp>
 
 namespace pp
 {
 	class Selector;
 
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Options of actor execution mode, see Router::enableActorExecution.
+	class ActorOptions
+	{
+	public:
+		// pins workers of consecutive plugins to consecutive cores
+		bool pinToCores = false;
+		// core the worker of the first plugin is pinned to
+		unsigned firstCore = 0;
+	};
+
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
 	//-------------------------------------------------------------------------------------------------------
@@ -25,8 +55,51 @@ namespace pp
 		Router() : m_selector(std::make_shared<Selector>()) {}
 
 		// Allows for the user to provide custom handler selector.
-		// @param selector - handler selector provided by the user
-		Router(std::shared_ptr<Selector> selector) : m_selector(std::move(selector)) {}
+		// @param selector - handler selector provided by the user, the
+		//		default one is used if it's null
+		Router(std::shared_ptr<Selector> selector) : m_selector(orDefault(std::move(selector))) {}
+
+		// Allows for the user to provide custom handler selector and a
+		// thread pool used to run independent event receivers 
+		// concurrently.
+		// @param selector - handler selector provided by the user, the
+		//		default one is used if it's null (e.g. until a selector
+		//		observing the router is installed with 'setSelector')
+		// @param threadPool - pool on which event receivers will be 
+		//		executed, if it's null receivers are called on the 
+		//		dispatching thread
+		Router(std::shared_ptr<Selector> selector, std::shared_ptr<ThreadPool> threadPool) 
+			: m_selector(orDefault(std::move(selector))), m_threadPool(std::move(threadPool)) {}
+
+		// Waits for handlers started by 'processIntentWithin' that 
+		// didn't finish in time.
+		~Router() { waitForAttempts(); }
+
+		// Replaces the handler selector. Selectors observing the router
+		// (e.g. FastestHandlerSelector) can be installed only after it
+		// is created. Must not be called while intents or events are 
+		// dispatched.
+		// @param selector - handler selector provided by the user, the
+		//		default one is used if it's null
+		void setSelector(std::shared_ptr<Selector> selector) { m_selector = orDefault(std::move(selector)); }
+
+		// Switches the router to actor execution mode. Every plugin
+		// gets its own mailbox processed by a dedicated thread and all
+		// of its handlers and receivers are called on that thread, one
+		// at a time, so plugins don't need to synchronize their state.
+		// Callers of 'processIntent' wait for the result, receivers of
+		// different plugins run concurrently. A handler waiting for 
+		// a handler of another plugin lets its own mailbox process 
+		// other messages meanwhile (see Mailbox::call).
+		// @throws std::logic_error if any plugin already registered, 
+		//		its handlers would run outside of a mailbox
+		// @param options - thread affinity of mailbox workers
+		void enableActorExecution(ActorOptions options = {})
+		{
+			if (!m_handlers.empty() || !m_receivers.empty())
+				throw std::logic_error("Actor execution has to be enabled before plugins register");
+			m_actorOptions = options;
+		}
 
 		// Registers intent handler in this router. If someone
 		// dispatches an intent with type matching given handler with 
@@ -45,8 +118,40 @@ namespace pp
 		template <typename T>
 		void registerIntentHandler(PluginInfo info, std::function<typename T::Result(T)> handler);
 
+		// Registers a family of instances of a stateful intent handler
+		// (e.g. per session or per entity processor) so it isn't a
+		// single serialization point. Every instance (shard) gets its 
+		// own mailbox thread and intents are routed to shards by 
+		// consistent hashing of their partition key (see 
+		// IsPartitioned), so intents with equal keys are processed by
+		// the same shard. They keep the order of dispatching only if
+		// they're dispatched from a single thread. For the selector 
+		// the whole family is a single handler. Mailboxes of the shards
+		// are stopped when the plugin is unregistered or suspended.
+		// @tparam T - partitioned intent type
+		// @param info - info of the plugin that registers the handlers
+		// @param shardsCount - number of handler instances, 0 is 
+		//		treated as 1
+		// @param createShard - called once for every shard index, 
+		//		returns handler of that shard
+		template <typename T>
+		void registerShardedIntentHandler(PluginInfo info, std::size_t shardsCount, 
+			const std::function<std::function<typename T::Result(T)>(std::size_t)>& createShard);
+
+		// Registers event receiver in this router. All receivers 
+		// chosen by the selector are called when an event is 
+		// dispatched with 'processEvent'.
+		// @tparam T - type of an event which can be processed by the 
+		//		given 'receiver'
+		// @param info - info of the plugin that registers the receiver,
+		//		its name is referenced by ordering constraints of other
+		//		receivers
+		// @param receiver - event receiver to register
+		// @param order - receivers of plugins this one has to run 
+		//		after/before, the dependency graph is rebuilt here so 
+		//		dispatching doesn't pay for it
 		template <typename T>
-		void registerEventReceiver(PluginInfo info, std::function<typename T::Result(const T&)> receiver);
+		void registerEventReceiver(PluginInfo info, std::function<typename T::Result(const T&)> receiver, ReceiverOrder order = {});
 
 		// This method is used for intents dispatching. When it's 
 		// called it asks the handler selector which intent handler 
@@ -59,17 +164,337 @@ namespace pp
 		template <typename T>
 		std::optional<typename T::Result> processIntent(T intent);
 
+		// Dispatches the intent with a latency budget. Handlers are 
+		// tried in order returned by Selector::rankHandlers. If the
+		// current handler doesn't finish in time (part of the budget 
+		// is kept for the next one) or throws HandlerOverloaded the 
+		// next handler is started. Late handlers are not cancelled, 
+		// the first result that arrives before the deadline wins. 
+		// Handlers are executed on the thread pool if the router has
+		// one so the intent type must be copyable, unregistering a 
+		// plugin waits for all late handlers. Without a pool handlers
+		// are called one by one on the calling thread and a slow 
+		// handler can't be abandoned, the next one is only tried if 
+		// the previous one fails. The results cache isn't used by this
+		// method.
+		// @tparam T - type of the intent that needs to be processed
+		// @returns status of the dispatch and the result of the 
+		//		handler if it finished in time
+		// @param intent - intent that needs to be processed
+		// @param budget - maximal time this method may take
+		template <typename T>
+		DispatchResult<typename T::Result> processIntentWithin(T intent, std::chrono::nanoseconds budget);
+
+		// Enables measuring latency of every intent handler call in
+		// 'processIntent'. It's needed only if the selector uses the 
+		// latencies, calls made by 'processIntentWithin' are always 
+		// measured.
+		// @param enabled - true to measure handler calls
+		void setLatencyTracking(bool enabled) { m_latencyTracking.store(enabled, std::memory_order_relaxed); }
+
+		// @returns average recent latencies of handlers of the given 
+		//		intent (indices match Selector indices), negative for 
+		//		handlers that weren't measured yet
+		// @param info - info of the intent type
+		std::vector<std::chrono::nanoseconds> getHandlerLatencies(const IntentInfo& info) const
+		{
+			const HandlersCollectionBase* const collection = findCollection(m_handlers, info);
+			return collection ? collection->getLatencies() : std::vector<std::chrono::nanoseconds>{};
+		}
+
+		// @returns first call and steady state latency of every intent
+		//		handler, the first call usually pays for page faults 
+		//		and lazy initialization (see PluginsContainer::warmUp).
+		//		Only calls measured with latency tracking enabled and
+		//		calls made by 'processIntentWithin' are included.
+		std::vector<HandlerLatencyReport> getLatencyReport() const;
+
+		// This method is used for events dispatching. Receivers chosen
+		// by the selector are called in the order that satisfies their
+		// constraints. If the router has a thread pool independent 
+		// receivers are executed concurrently. Receivers of stoppable
+		// events (see IsStoppable) are always called one by one until
+		// one of them consumes the event.
+		// @tparam T - type of the event that needs to be processed
+		// @returns results of the receivers, indices match indices 
+		//		returned by the selector, receivers skipped after the 
+		//		event was consumed have empty results
+		// @param event - event that needs to be processed
 		template <typename T>
 		std::vector<std::optional<typename T::Result>> processEvent(const T& event);
 
+		// Queues the event until 'dispatchPostedEvents' is called. If 
+		// the event type is coalescable (see IsCoalescable) and an 
+		// event with the same key is already queued the events are 
+		// merged so receivers are called only once. This method is
+		// thread safe.
+		// @tparam T - type of the posted event
+		// @param event - event that will be dispatched later
+		template <typename T>
+		void postEvent(T event);
+
+		// Dispatches all events posted since the previous call (the 
+		// dispatch window). Events posted by receivers during this 
+		// call are queued for the next window. Events are dispatched
+		// grouped by type, in order of posting within a type.
+		void dispatchPostedEvents();
+
+		// @returns counters of posted events with given info
+		// @param info - info of the event type
+		CoalescingStats getCoalescingStats(const EventInfo& info) const
+		{
+			std::lock_guard<std::mutex> lock(m_postedEventsMutex);
+			const auto it = m_coalescingStats.find(info);
+			return it != m_coalescingStats.end() ? it->second : CoalescingStats{};
+		}
+
+		// Removes all intent handlers and event receivers registered by
+		// the plugin with given name. Results cached for intents that
+		// this plugin was handling are invalidated.
+		// @returns number of removed handlers and receivers
+		// @param pluginName - name of the plugin
+		std::size_t unregisterPlugin(const std::string& pluginName);
+
+		// Sets the size of results caches of cacheable intents (see 
+		// IsCacheable). Applies to intents whose first handler is 
+		// registered after this call.
+		// @param capacity - maximal number of cached results per intent
+		// @param shardsCount - number of independently locked shards
+		void setIntentCacheCapacity(std::size_t capacity, std::size_t shardsCount)
+		{
+			m_intentCacheCapacity = capacity;
+			m_intentCacheShardsCount = shardsCount;
+		}
+
+		// @returns hit/miss counters of the results cache of given
+		//		intent, all zeros if the intent isn't cacheable or has
+		//		no handlers
+		// @param info - info of the intent type
+		IntentCacheStats getIntentCacheStats(const IntentInfo& info) const
+		{
+			const HandlersCollectionBase* const collection = findCollection(m_handlers, info);
+			if (!collection || !collection->getCache())
+				return {};
+			return collection->getCache()->getStats();
+		}
+
+		// @returns pool of payload buffers shared by the host and all 
+		//		plugins registered in this router, payloads acquired from
+		//		it may be attached to intents and events and retained by
+		//		their handlers
+		PayloadPool& getPayloadPool() { return m_payloadPool; }
+
+		// @returns number of intent handlers registered in this router
+		std::size_t getHandlersCount() const
+		{
+			std::shared_lock<std::shared_mutex> lock(m_registryMutex);
+			std::size_t result = 0;
+			for (const auto& [info, collection] : m_handlers)
+				if (collection)
+					result += collection->getPluginsInfo().size();
+			return result;
+		}
+
+		// @returns number of event receivers registered in this router
+		std::size_t getReceiversCount() const
+		{
+			std::shared_lock<std::shared_mutex> lock(m_registryMutex);
+			std::size_t result = 0;
+			for (const auto& [info, collection] : m_receivers)
+				if (collection)
+					result += collection->getPluginsInfo().size();
+			return result;
+		}
+
+		// @returns ordering constraints of receivers of given event that
+		//		are ignored because they form a cycle with constraints
+		//		registered earlier, pairs of plugin names: the first was
+		//		supposed to run before the second
+		// @param info - info of the event type
+		std::vector<std::pair<std::string, std::string>> getIgnoredReceiverConstraints(const EventInfo& info) const
+		{
+			const ReceiversCollectionBase* const collection = findCollection(m_receivers, info);
+			return collection ? collection->getIgnoredConstraints() : std::vector<std::pair<std::string, std::string>>{};
+		}
+
+		// Enables tracking of the last use time and memory of every 
+		// plugin (see PluginUsage) which is needed to suspend plugins.
+		// @throws std::logic_error if any plugin already registered, 
+		//		the registry wouldn't be guarded for its reloads
+		void enableUsageTracking()
+		{
+			if (!m_handlers.empty() || !m_receivers.empty())
+				throw std::logic_error("Usage tracking has to be enabled before plugins register");
+			m_usageTracking = true;
+		}
+
+		// @returns usage of the plugin with given name or nullptr if
+		//		usage tracking is disabled or the plugin didn't 
+		//		register anything
+		// @param pluginName - name of the plugin
+		std::shared_ptr<const PluginUsage> getPluginUsage(const std::string& pluginName) const
+		{
+			std::shared_lock<std::shared_mutex> lock(m_registryMutex);
+			const auto it = m_usages.find(pluginName);
+			return it != m_usages.end() ? it->second : nullptr;
+		}
+
+		// Removes handlers and receivers of the plugin until any of its
+		// intents or events is dispatched again. Then 'loader' is 
+		// called on the dispatching thread, it's expected to create the
+		// plugin again and register the same handlers which get their
+		// original indices back. Dispatches that need a suspended 
+		// plugin wait while it's loaded, the others may go on since 
+		// the loader only changes handlers of the suspended plugin's
+		// intents and events. Requires usage tracking, must not be 
+		// called while intents or events are dispatched.
+		// @returns false if the plugin has no handlers nor receivers, 
+		//		nothing is done then
+		// @param pluginName - name of the plugin
+		// @param deinit - called before the handlers are removed, the 
+		//		plugin should release everything but its library here
+		// @param loader - called to load the plugin again
+		bool suspendPlugin(const std::string& pluginName, const std::function<void(Router&)>& deinit, std::function<void(Router&)> loader);
+
+		// @returns true if the plugin was suspended and it wasn't loaded
+		//		again yet
+		// @param pluginName - name of the plugin
+		bool isPluginSuspended(const std::string& pluginName) const
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_suspendedPluginsMutex);
+			return m_suspendedPlugins.count(pluginName) > 0;
+		}
+
 	private:
+		class SuspendedPlugin
+		{
+		public:
+			std::function<void(Router&)> loader;
+			std::vector<IntentInfo> intents;
+			std::vector<EventInfo> events;
+		};
+
+		// @returns usage of the plugin, created on first use, or 
+		//		nullptr if usage tracking is disabled
+		std::shared_ptr<PluginUsage> addPluginUsage(const std::string& pluginName);
+
+		// @returns registration order of a new handler or receiver of
+		//		the plugin, a reloaded plugin gets the same numbers as 
+		//		when it was loaded for the first time
+		std::uint64_t getRegistrationSequence(const std::string& pluginName);
+
+		// Loads suspended plugins that handle the intent or event with
+		// given info.
+		// @param info - info of the dispatched intent or event
+		// @param suspendedCounts - number of suspended plugins per info
+		template <typename Info>
+		void resumePlugins(const Info& info, const std::map<Info, std::atomic<int>>& suspendedCounts);
+
+		// @returns mailbox of the plugin, created on first use, or 
+		//		nullptr if actor execution is disabled
+		std::shared_ptr<Mailbox> getPluginMailbox(const std::string& pluginName);
+
+		// @returns new mailbox pinned to the next core if actor 
+		//		execution is enabled with pinning
+		std::shared_ptr<Mailbox> createMailbox();
+
+		// Stops workers of the plugin's mailbox and of its shards.
+		// Copies of its handlers may still reference them so they are
+		// stopped explicitly before the plugin's library is unloaded.
+		// @param pluginName - name of the plugin
+		void stopPluginMailboxes(const std::string& pluginName);
+
+		// Adds the handler to the collection of its intent.
+		template <typename T>
+		void addIntentHandler(PluginInfo info, std::function<typename T::Result(T)> handler, std::uint64_t sequence, std::shared_ptr<PluginUsage> usage);
+
+		template <typename T>
+		typename T::Result callHandler(const HandlersCollection<T>& handlers, int index, T intent);
+
+		// @returns collection registered for the info or nullptr, the
+		//		map is locked for the lookup if plugins may be loaded 
+		//		again by dispatching threads
+		template <typename Map>
+		typename Map::mapped_type::pointer findCollection(const Map& collections, const typename Map::key_type& info) const;
+
+		// Creates objects shared with the plugins, see m_createUsage.
+		template <typename T, typename... Args>
+		static std::shared_ptr<T> createShared(Args... args) { return std::make_shared<T>(std::move(args)...); }
+
+		// @returns given selector or the default one if it's null
+		// @param selector - selector provided by the user
+		static std::shared_ptr<Selector> orDefault(std::shared_ptr<Selector> selector);
+
+		// Blocks until late attempts of 'processIntentWithin' finish.
+		// The attempts are code of the library that dispatched the 
+		// intent and they call a handler of another plugin so all of
+		// them are awaited before any plugin is unloaded.
+		void waitForAttempts();
+
+		template <typename T>
+		std::vector<std::optional<typename T::Result>> processStoppableEvent(const ReceiversCollection<T>& receivers, 
+			const std::vector<int>& chosenReceivers, const T& event);
+
+		template <typename T>
+		std::vector<std::optional<typename T::Result>> processEventConcurrently(const ReceiversCollection<T>& receivers, 
+			const std::vector<int>& chosenReceivers, const T& event);
+
 		std::shared_ptr<Selector> m_selector;
+		std::shared_ptr<ThreadPool> m_threadPool;
 
 		// Handlers are mapped by intent info so older intents (with 
 		// older version) also can be processed if handler with 
 		// matching intent type is registered in this intent router.
 		std::map<IntentInfo, std::unique_ptr<HandlersCollectionBase>> m_handlers;
 		std::map<EventInfo, std::unique_ptr<ReceiversCollectionBase>> m_receivers;
+
+		std::size_t m_intentCacheCapacity = 1024;
+		std::size_t m_intentCacheShardsCount = 16;
+		std::atomic<bool> m_latencyTracking = false;
+
+		// Suspended plugins are loaded again on dispatching threads, 
+		// with usage tracking enabled the maps they register into are
+		// locked. Dispatching locks them only for the lookup.
+		mutable std::shared_mutex m_registryMutex;
+
+		// The router is created by the host so these point to the 
+		// host's code. Control blocks of shared objects created in a
+		// plugin's code would refer to its library which may be 
+		// unloaded before the objects are released.
+		std::shared_ptr<PluginUsage> (*m_createUsage)() = &createShared<PluginUsage>;
+		std::shared_ptr<HandlerLatency> (*m_createLatency)() = &createShared<HandlerLatency>;
+		std::shared_ptr<Mailbox> (*m_createMailbox)(std::optional<unsigned>) = &createShared<Mailbox, std::optional<unsigned>>;
+
+		bool m_usageTracking = false;
+		std::map<std::string, std::shared_ptr<PluginUsage>> m_usages;
+		std::map<std::string, std::vector<std::uint64_t>> m_registrationSequences;
+		std::uint64_t m_nextSequence = 0;
+		std::string m_reloadedPlugin;
+		std::size_t m_reloadedRegistrationsCount = 0;
+
+		// Maps of suspended infos are filled only by 'suspendPlugin' so
+		// dispatching may read them without the lock, only the counters
+		// change when plugins are loaded again.
+		mutable std::recursive_mutex m_suspendedPluginsMutex;
+		std::map<std::string, SuspendedPlugin> m_suspendedPlugins;
+		std::atomic<std::size_t> m_suspendedPluginsCount = 0;
+		std::map<IntentInfo, std::atomic<int>> m_suspendedIntents;
+		std::map<EventInfo, std::atomic<int>> m_suspendedEvents;
+
+		// attempts of 'processIntentWithin' not yet finished and 
+		// destroyed by the pool
+		std::atomic<std::size_t> m_pendingAttemptsCount = 0;
+
+		std::optional<ActorOptions> m_actorOptions;
+		std::map<std::string, std::shared_ptr<Mailbox>> m_mailboxes;
+		std::map<std::string, std::vector<std::shared_ptr<Mailbox>>> m_shardMailboxes;
+		unsigned m_nextCore = 0;
+
+		mutable std::mutex m_postedEventsMutex;
+		std::vector<std::unique_ptr<PostedEventsBase>> m_postedEvents;
+		std::map<EventInfo, CoalescingStats> m_coalescingStats;
+
+		PayloadPool m_payloadPool;
 	}; // class Router
 
 	//-------------------------------------------------------------------------------------------------------
@@ -104,71 +529,984 @@ namespace pp
 			std::iota(result.begin(), result.end(), 0);
 			return result;
 		}
+
+		// This method is called by Router::processIntentWithin. 
+		// Default implementation puts the handler chosen by 
+		// 'selectHandler' first and the rest of handlers from the 
+		// fastest one, handlers that weren't measured yet go last.
+		// @returns indices of handlers in order in which they should 
+		//		be tried, handlers that are not present won't be used
+		// @param intent - intent info of an intent that needs to be 
+		//		processed
+		// @param handlers - collection of available handlers
+		// @param latencies - recent average latencies of handlers 
+		//		(indices match), negative if not measured yet
+		virtual std::vector<int> rankHandlers(IntentInfo intent, std::vector<PluginInfo> handlers, std::vector<std::chrono::nanoseconds> latencies)
+		{
+			const int chosenHandler = selectHandler(intent, std::move(handlers));
+
+			std::vector<int> result;
+			for (int i = 0; i < static_cast<int>(latencies.size()); ++i)
+				if (i != chosenHandler)
+					result.push_back(i);
+			sortByLatency(result, latencies);
+
+			result.insert(result.begin(), chosenHandler);
+			return result;
+		}
+
+	protected:
+		// Sorts handler indices from the fastest handler, not measured
+		// handlers are moved to the end.
+		static void sortByLatency(std::vector<int>& indices, const std::vector<std::chrono::nanoseconds>& latencies)
+		{
+			std::stable_sort(indices.begin(), indices.end(), [&latencies](int left, int right)
+			{
+				const auto leftLatency = latencies[left], rightLatency = latencies[right];
+				if (leftLatency.count() < 0 || rightLatency.count() < 0)
+					return rightLatency.count() < 0 && leftLatency.count() >= 0;
+				return leftLatency < rightLatency;
+			});
+		}
 	}; // class Selector
 
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Selector that prefers the fastest implementation. Handlers that 
+	// weren't measured yet are chosen first so every handler gets 
+	// measured. Latencies are available to 'selectHandler' only if 
+	// latency tracking is enabled in the Router.
+	class FastestHandlerSelector : public Selector
+	{
+	public:
+		// The selector has to be installed after the router is 
+		// created (see Router::setSelector):
+		//		auto router = std::make_shared<pp::Router>();
+		//		router->setSelector(std::make_shared<pp::FastestHandlerSelector>(*router));
+		// @param router - router whose handler latencies are used
+		FastestHandlerSelector(const Router& router) : m_router(router) {}
+
+		int selectHandler(IntentInfo intent, std::vector<PluginInfo> handlers) override
+		{
+			const std::vector<int> ranking = rankHandlers(intent, std::move(handlers), m_router.getHandlerLatencies(intent));
+			return ranking.empty() ? 0 : ranking.front();
+		}
+
+		std::vector<int> rankHandlers(IntentInfo /*intent*/, std::vector<PluginInfo> handlers, std::vector<std::chrono::nanoseconds> latencies) override
+		{
+			// handlers that aren't known to the router weren't measured
+			latencies.resize(handlers.size(), std::chrono::nanoseconds(-1));
+
+			std::vector<int> result(handlers.size());
+			std::iota(result.begin(), result.end(), 0);
+			sortByLatency(result, latencies);
+
+			// exploration of not measured handlers
+			std::stable_partition(result.begin(), result.end(), [&latencies](int index) { return latencies[index].count() < 0; });
+			return result;
+		}
+
+	private:
+		const Router& m_router;
+	}; // class FastestHandlerSelector
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::shared_ptr<Selector> Router::orDefault(std::shared_ptr<Selector> selector)
+	{
+		return selector ? std::move(selector) : std::make_shared<Selector>();
+	}
+
 	//-------------------------------------------------------------------------------------------------------
 	template<typename T>
 	inline void Router::registerIntentHandler(PluginInfo info, std::function<typename T::Result(T)> handler)
 	{
-		const auto it = m_handlers.find(T::Info);
-		if (it != m_handlers.end())
-			static_cast<HandlersCollection<T>*>(it->second.get())->push_back({ std::move(info), std::move(handler) });
-		else
+		std::shared_ptr<PluginUsage> usage = addPluginUsage(info.name);
+		const std::uint64_t sequence = getRegistrationSequence(info.name);
+
+		if (std::shared_ptr<Mailbox> mailbox = getPluginMailbox(info.name))
 		{
-			auto newCollection = std::make_unique<HandlersCollection<T>>();
-			newCollection->push_back({ std::move(info), std::move(handler) });
-			m_handlers.insert({ T::Info, std::move(newCollection) });
+			// the scope has to be entered on the worker as well so its
+			// allocations are attributed to the plugin
+			handler = [mailbox = std::move(mailbox), usage, handler = std::move(handler)](T intent)
+			{
+				return mailbox->call([&]
+				{
+					PluginUsage::Scope scope(usage.get());
+					return handler(std::move(intent));
+				});
+			};
 		}
+
+		addIntentHandler<T>(std::move(info), std::move(handler), sequence, std::move(usage));
 	}
 
 	//-------------------------------------------------------------------------------------------------------
 	template<typename T>
-	inline void Router::registerEventReceiver(PluginInfo info, std::function<typename T::Result(const T&)> receiver)
+	inline void Router::registerShardedIntentHandler(PluginInfo info, std::size_t shardsCount, 
+		const std::function<std::function<typename T::Result(T)>(std::size_t)>& createShard)
 	{
-		const auto it = m_receivers.find(T::Info);
-		if (it != m_receivers.end())
-			static_cast<ReceiversCollection<T>*>(it->second.get())->push_back({ std::move(info), std::move(receiver) });
+		std::shared_ptr<PluginUsage> usage = addPluginUsage(info.name);
+		const std::uint64_t sequence = getRegistrationSequence(info.name);
+
+		std::vector<std::function<typename T::Result(T)>> handlers;
+		std::vector<std::shared_ptr<Mailbox>> mailboxes;
+		for (std::size_t i = 0; i < std::max<std::size_t>(1, shardsCount); ++i)
+		{
+			handlers.push_back(createShard(i));
+			mailboxes.push_back(createMailbox());
+		}
+
+		// shards don't use the plugin's mailbox even in actor mode, 
+		// their mailboxes are stopped with the plugin's one
+		{
+			std::unique_lock<std::shared_mutex> lock(m_registryMutex, std::defer_lock);
+			if (m_usageTracking)
+				lock.lock();
+
+			std::vector<std::shared_ptr<Mailbox>>& pluginShards = m_shardMailboxes[info.name];
+			pluginShards.insert(pluginShards.end(), mailboxes.begin(), mailboxes.end());
+		}
+
+		const auto sharded = std::make_shared<const ShardedIntentHandler<T>>(std::move(handlers), std::move(mailboxes), usage);
+		addIntentHandler<T>(std::move(info), [sharded](T intent) { return (*sharded)(std::move(intent)); }, sequence, std::move(usage));
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template<typename T>
+	inline void Router::addIntentHandler(PluginInfo info, std::function<typename T::Result(T)> handler, std::uint64_t sequence, std::shared_ptr<PluginUsage> usage)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_registryMutex, std::defer_lock);
+		if (m_usageTracking)
+			lock.lock();
+
+		std::unique_ptr<HandlersCollectionBase>& collection = m_handlers[T::Info];
+		if (collection)
+		{
+			static_cast<HandlersCollection<T>*>(collection.get())->add(std::move(info), std::move(handler), sequence, std::move(usage), m_createLatency());
+
+			// the selector may choose the new handler from now on
+			if (collection->getCache())
+				collection->getCache()->invalidate();
+		}
 		else
 		{
-			auto newCollection = std::make_unique<ReceiversCollection<T>>();
-			newCollection->push_back({ std::move(info), std::move(receiver) });
-			m_receivers.insert({ T::Info, std::move(newCollection) });
+			auto newCollection = std::make_unique<HandlersCollection<T>>(m_intentCacheCapacity, m_intentCacheShardsCount);
+			newCollection->add(std::move(info), std::move(handler), sequence, std::move(usage), m_createLatency());
+			collection = std::move(newCollection);
 		}
 	}
 
+	//-------------------------------------------------------------------------------------------------------
+	template<typename T>
+	inline void Router::registerEventReceiver(PluginInfo info, std::function<typename T::Result(const T&)> receiver, ReceiverOrder order)
+	{
+		std::shared_ptr<PluginUsage> usage = addPluginUsage(info.name);
+		const std::uint64_t sequence = getRegistrationSequence(info.name);
+		std::shared_ptr<Mailbox> mailbox = getPluginMailbox(info.name);
+
+		std::unique_lock<std::shared_mutex> lock(m_registryMutex, std::defer_lock);
+		if (m_usageTracking)
+			lock.lock();
+
+		std::unique_ptr<ReceiversCollectionBase>& collection = m_receivers[T::Info];
+		if (!collection)
+			collection = std::make_unique<ReceiversCollection<T>>();
+		static_cast<ReceiversCollection<T>*>(collection.get())->add(std::move(info), std::move(receiver), std::move(order), 
+			std::move(mailbox), sequence, std::move(usage));
+	}
+
 	//-------------------------------------------------------------------------------------------------------
 	template<typename T>
 	inline std::optional<typename T::Result> Router::processIntent(T intent)
 	{
-		const auto it = m_handlers.find(T::Info);
-		if (it != m_handlers.end())
+		if (m_suspendedPluginsCount.load() > 0)
+			resumePlugins(T::Info, m_suspendedIntents);
+
+		if (const auto handlersCollection = static_cast<HandlersCollection<T>*>(findCollection(m_handlers, T::Info)))
 		{
-			const auto handlersCollection = static_cast<HandlersCollection<T>*>(it->second.get());
+			if (handlersCollection->empty())
+				return {};
+
 			const int chosenHandler = m_selector->selectHandler(T::Info, handlersCollection->getPluginsInfo());
-			return handlersCollection->at(chosenHandler).second(std::move(intent));
+
+			if constexpr (IsCacheable<T>::value)
+			{
+				// The generation is read before selecting the handler, a
+				// concurrent dispatch switching to another handler then
+				// invalidates the cache after this read and the result
+				// of the no longer selected handler isn't stored.
+				IntentCache<T>& cache = handlersCollection->getIntentCache();
+				const std::uint64_t generation = cache.getGeneration();
+				cache.selectHandler(chosenHandler);
+
+				auto key = T::cacheKey(intent);
+				if (std::optional<typename T::Result> cached = cache.find(key))
+					return cached;
+
+				typename T::Result result = callHandler(*handlersCollection, chosenHandler, std::move(intent));
+				cache.insert(std::move(key), generation, result);
+				return result;
+			}
+			else
+				return callHandler(*handlersCollection, chosenHandler, std::move(intent));
 		}
 		else
 			return {};
 	}
 
+	//-------------------------------------------------------------------------------------------------------
+	template<typename T>
+	inline typename T::Result Router::callHandler(const HandlersCollection<T>& handlers, int index, T intent)
+	{
+		PluginUsage::Scope scope(handlers.getUsage(index).get());
+		if (!m_latencyTracking.load(std::memory_order_relaxed))
+			return handlers.at(index).second(std::move(intent));
+
+		const auto start = std::chrono::steady_clock::now();
+		typename T::Result result = handlers.at(index).second(std::move(intent));
+		handlers.getLatency(index)->record(std::chrono::steady_clock::now() - start);
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template<typename T>
+	inline DispatchResult<typename T::Result> Router::processIntentWithin(T intent, std::chrono::nanoseconds budget)
+	{
+		using Clock = std::chrono::steady_clock;
+		using Result = typename T::Result;
+		const Clock::time_point deadline = Clock::now() + budget;
+
+		if (m_suspendedPluginsCount.load() > 0)
+			resumePlugins(T::Info, m_suspendedIntents);
+
+		const auto handlersCollection = static_cast<HandlersCollection<T>*>(findCollection(m_handlers, T::Info));
+		if (!handlersCollection || handlersCollection->empty())
+			return {};
+
+		const std::vector<std::chrono::nanoseconds> latencies = handlersCollection->getLatencies();
+		const std::vector<int> candidates = m_selector->rankHandlers(T::Info, handlersCollection->getPluginsInfo(), latencies);
+		if (candidates.empty())
+			return {};
+
+		// Shared with the attempts because the late ones may outlive 
+		// this call.
+		struct DispatchState
+		{
+			struct Outcome
+			{
+				std::optional<Result> value;
+				bool overloaded = false;
+				std::exception_ptr exception;
+			};
+
+			static Outcome call(const std::function<Result(T)>& handler, HandlerLatency& latency, PluginUsage* usage, T intent)
+			{
+				Outcome outcome;
+				const Clock::time_point start = Clock::now();
+				try
+				{
+					PluginUsage::Scope scope(usage);
+					outcome.value = handler(std::move(intent));
+				}
+				catch (const HandlerOverloaded&)
+				{
+					outcome.overloaded = true;
+				}
+				catch (...)
+				{
+					outcome.exception = std::current_exception();
+				}
+				latency.record(Clock::now() - start);
+				return outcome;
+			}
+
+			void add(Outcome outcome, int index)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (outcome.value && !value)
+				{
+					value = std::move(outcome.value);
+					handlerIndex = index;
+				}
+				else if (!outcome.value)
+				{
+					++failedCount;
+					overloaded = overloaded || outcome.overloaded;
+					if (outcome.exception && !exception)
+						exception = outcome.exception;
+				}
+				finished.notify_all();
+			}
+
+			std::mutex mutex;
+			std::condition_variable finished;
+			std::optional<Result> value;
+			int handlerIndex = -1;
+			int failedCount = 0;
+			bool overloaded = false;
+			std::exception_ptr exception;
+		};
+		const auto state = std::make_shared<DispatchState>();
+
+		// Without a pool a late handler can't be abandoned. Handlers 
+		// are called one by one on this thread and the next one is 
+		// tried only if the previous one failed in time.
+		if (!m_threadPool)
+		{
+			for (const int index : candidates)
+			{
+				if (Clock::now() >= deadline)
+					break;
+
+				typename DispatchState::Outcome outcome = DispatchState::call(handlersCollection->at(index).second, 
+					*handlersCollection->getLatency(index), handlersCollection->getUsage(index).get(), intent);
+				if (outcome.value && Clock::now() > deadline)
+					break;
+
+				state->add(std::move(outcome), index);
+				if (state->value)
+					break;
+			}
+		}
+		else
+		{
+			const auto launch = [&](int index)
+			{
+				// handler and latency are copied so the attempt doesn't 
+				// depend on the collection if it outlives this call, the
+				// pool counts it as pending until it's destroyed
+				m_pendingAttemptsCount.fetch_add(1);
+				m_threadPool->submit([state, index, intent,
+					handler = handlersCollection->at(index).second, 
+					latency = handlersCollection->getLatency(index),
+					usage = handlersCollection->getUsage(index)]() mutable
+				{
+					state->add(DispatchState::call(handler, *latency, usage.get(), std::move(intent)), index);
+				}, &m_pendingAttemptsCount);
+			};
+
+			// A worker of the pool helps with the pending tasks instead 
+			// of blocking, the attempts may be queued behind them.
+			std::unique_lock<std::mutex> lock(state->mutex);
+			const auto waitFor = [&](Clock::time_point time, const auto& done)
+			{
+				if (!m_threadPool->isWorkerThread())
+				{
+					state->finished.wait_until(lock, time, done);
+					return;
+				}
+
+				lock.unlock();
+				m_threadPool->waitUntil([&]
+				{
+					std::lock_guard<std::mutex> stateLock(state->mutex);
+					return done();
+				}, time);
+				lock.lock();
+			};
+
+			for (std::size_t i = 0; i < candidates.size(); ++i)
+			{
+				const Clock::time_point now = Clock::now();
+				if (now >= deadline)
+					break;
+
+				// Part of the remaining budget is kept for the next handler:
+				// its recent latency if it fits, half of the rest otherwise.
+				Clock::time_point cutoff = deadline;
+				if (i + 1 < candidates.size())
+				{
+					const std::chrono::nanoseconds remaining = deadline - now;
+					const std::chrono::nanoseconds nextLatency = latencies[candidates[i + 1]];
+					cutoff = deadline - (nextLatency.count() >= 0 && nextLatency < remaining ? nextLatency : remaining / 2);
+				}
+
+				// the next handler is started as soon as any of the running
+				// ones fails
+				const int failedCount = state->failedCount;
+				lock.unlock();
+				launch(candidates[i]);
+				lock.lock();
+
+				waitFor(cutoff, [&] { return state->value || state->failedCount > failedCount; });
+				if (state->value)
+					break;
+			}
+
+			// late attempts still may finish before the deadline
+			waitFor(deadline, [&] { return state->value || state->failedCount == static_cast<int>(candidates.size()); });
+		}
+
+		std::lock_guard<std::mutex> lock(state->mutex);
+		DispatchResult<Result> result;
+		if (state->value)
+		{
+			result.status = eDispatchStatus::SUCCESS;
+			result.value = std::move(state->value);
+			result.handlerIndex = state->handlerIndex;
+		}
+		else if (state->exception && state->failedCount == static_cast<int>(candidates.size()))
+			std::rethrow_exception(state->exception);
+		else if (state->overloaded && state->failedCount == static_cast<int>(candidates.size()))
+			result.status = eDispatchStatus::OVERLOADED;
+		else
+			result.status = eDispatchStatus::TIMEOUT;
+
+		return result;
+	}
+
 	//-------------------------------------------------------------------------------------------------------
 	template<typename T>
 	inline std::vector<std::optional<typename T::Result>> Router::processEvent(const T& event)
 	{
-		const auto it = m_receivers.find(T::Info);
-		if (it != m_receivers.end())
+		if (m_suspendedPluginsCount.load() > 0)
+			resumePlugins(T::Info, m_suspendedEvents);
+
+		if (const auto receiversCollection = static_cast<ReceiversCollection<T>*>(findCollection(m_receivers, T::Info)))
 		{
-			const auto receiversCollection = static_cast<ReceiversCollection<T>*>(it->second.get());
 			const std::vector<int> chosenReceivers = m_selector->selectReceivers(T::Info, receiversCollection->getPluginsInfo());
+
+			if constexpr (IsStoppable<T>::value)
+				return processStoppableEvent(*receiversCollection, chosenReceivers, event);
+
+			if (receiversCollection->hasMailboxes() || (m_threadPool && chosenReceivers.size() > 1))
+				return processEventConcurrently(*receiversCollection, chosenReceivers, event);
 			
 			std::vector<std::optional<typename T::Result>> result;
-			for (const int i : chosenReceivers)
-				result.push_back(receiversCollection->at(i).second(event));
+			if (!receiversCollection->hasDependencies())
+			{
+				for (const int i : chosenReceivers)
+				{
+					PluginUsage::Scope scope(receiversCollection->getUsage(i).get());
+					result.push_back(receiversCollection->at(i).second(event));
+				}
+			}
+			else
+			{
+				std::vector<int> positions(receiversCollection->size(), -1);
+				for (int i = 0; i < static_cast<int>(chosenReceivers.size()); ++i)
+					positions[chosenReceivers[i]] = i;
+
+				result.resize(chosenReceivers.size());
+				for (const int i : receiversCollection->getExecutionOrder())
+					if (positions[i] >= 0)
+					{
+						PluginUsage::Scope scope(receiversCollection->getUsage(i).get());
+						result[positions[i]] = receiversCollection->at(i).second(event);
+					}
+			}
 
 			return result;
 		}
 		else
 			return {};
 	}
-	
+
+	//-------------------------------------------------------------------------------------------------------
+	template<typename T>
+	inline std::vector<std::optional<typename T::Result>> Router::processStoppableEvent(const ReceiversCollection<T>& receivers, 
+		const std::vector<int>& chosenReceivers, const T& event)
+	{
+		std::vector<int> positions(receivers.size(), -1);
+		for (int i = 0; i < static_cast<int>(chosenReceivers.size()); ++i)
+			positions[chosenReceivers[i]] = i;
+
+		// receivers are pre-sorted by priority so the execution order 
+		// is the order of consumption
+		std::vector<std::optional<typename T::Result>> result(chosenReceivers.size());
+		for (const int i : receivers.hasDependencies() ? receivers.getExecutionOrder() : chosenReceivers)
+		{
+			if (positions[i] < 0)
+				continue;
+
+			const auto call = [&]
+			{
+				PluginUsage::Scope scope(receivers.getUsage(i).get());
+				return receivers.at(i).second(event);
+			};
+
+			std::optional<typename T::Result>& receiverResult = result[positions[i]];
+			if (const std::shared_ptr<Mailbox>& mailbox = receivers.getMailbox(i))
+				receiverResult = mailbox->call(call);
+			else
+				receiverResult = call();
+
+			if (T::stopsPropagation(*receiverResult))
+				break;
+		}
+
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template<typename T>
+	inline std::vector<std::optional<typename T::Result>> Router::processEventConcurrently(const ReceiversCollection<T>& receivers, 
+		const std::vector<int>& chosenReceivers, const T& event)
+	{
+		const int count = static_cast<int>(receivers.size());
+
+		std::vector<int> positions(count, -1);
+		for (int i = 0; i < static_cast<int>(chosenReceivers.size()); ++i)
+			positions[chosenReceivers[i]] = i;
+
+		// State of this dispatch lives on the stack of the dispatching
+		// thread which doesn't return before every receiver finishes.
+		std::vector<std::optional<typename T::Result>> result(chosenReceivers.size());
+		std::unique_ptr<std::atomic<int>[]> remaining(new std::atomic<int>[count]);
+		for (int i = 0; i < count; ++i)
+			remaining[i] = receivers.getPredecessorsCount(i);
+		std::atomic<int> finishedCount = 0;
+		std::atomic<bool> failed = false;
+		std::exception_ptr exception;
+
+		// Receivers are sent to their plugins' mailboxes in actor mode,
+		// otherwise to the thread pool. Without mailboxes the pool 
+		// wakes up the dispatching thread itself, with them the last 
+		// receiver does it: by a message if the dispatching thread is 
+		// a mailbox worker (it keeps processing its messages), with 
+		// the condition variable otherwise.
+		Mailbox* const waitingMailbox = receivers.hasMailboxes() ? Mailbox::getCurrent() : nullptr;
+		const bool waitsOnCondition = receivers.hasMailboxes() && !waitingMailbox;
+		std::mutex finishedMutex;
+		std::condition_variable allFinished;
+
+		const auto fail = [&](std::exception_ptr error)
+		{
+			if (!failed.exchange(true))
+				exception = std::move(error);
+		};
+
+		std::function<void(int)> run;
+		std::function<void(int)> finish;
+		const auto schedule = [&](int index)
+		{
+			if (positions[index] < 0)
+				finish(index); // not chosen receivers are skipped in place
+			else if (const std::shared_ptr<Mailbox>& mailbox = receivers.getMailbox(index))
+			{
+				// a stopped mailbox fails the dispatch instead of hanging it
+				if (!mailbox->post([&run, index] { run(index); }))
+				{
+					fail(std::make_exception_ptr(std::runtime_error("Mailbox is stopped")));
+					finish(index);
+				}
+			}
+			else if (m_threadPool)
+				m_threadPool->submit([&run, index] { run(index); });
+			else
+				run(index);
+		};
+
+		run = [&](int index)
+		{
+			try
+			{
+				PluginUsage::Scope scope(receivers.getUsage(index).get());
+				result[positions[index]] = receivers.at(index).second(event);
+			}
+			catch (...)
+			{
+				fail(std::current_exception());
+			}
+			finish(index);
+		};
+
+		finish = [&](int index)
+		{
+			for (const int successor : receivers.getSuccessors(index))
+				if (remaining[successor].fetch_sub(1) == 1)
+					schedule(successor);
+
+			// the counter must be the last access to the dispatch state,
+			// captures (even 'count') live in 'finish' owned by the waiter
+			const int total = count;
+			if (waitsOnCondition)
+			{
+				std::lock_guard<std::mutex> lock(finishedMutex);
+				if (finishedCount.fetch_add(1) + 1 == total)
+					allFinished.notify_one();
+			}
+			else if (Mailbox* const mailbox = waitingMailbox; finishedCount.fetch_add(1) + 1 == total && mailbox)
+				mailbox->wake();
+		};
+
+		for (int i = 0; i < count; ++i)
+			if (receivers.getPredecessorsCount(i) == 0)
+				schedule(i);
+
+		const auto isFinished = [&] { return finishedCount.load() == count; };
+		if (waitingMailbox)
+			waitingMailbox->processUntil(isFinished);
+		else if (waitsOnCondition)
+		{
+			std::unique_lock<std::mutex> lock(finishedMutex);
+			allFinished.wait(lock, isFinished);
+		}
+		else if (m_threadPool)
+			m_threadPool->waitUntil(isFinished);
+
+		if (exception)
+			std::rethrow_exception(exception);
+
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::vector<HandlerLatencyReport> Router::getLatencyReport() const
+	{
+		std::vector<HandlerLatencyReport> result;
+		for (const auto& [info, collection] : m_handlers)
+		{
+			if (!collection)
+				continue;
+
+			const std::vector<PluginInfo> plugins = collection->getPluginsInfo();
+			for (int i = 0; i < static_cast<int>(plugins.size()); ++i)
+			{
+				const HandlerLatency& latency = *collection->getLatency(i);
+
+				HandlerLatencyReport report;
+				report.intentName = info.name;
+				report.pluginName = plugins[i].name;
+				report.callsCount = latency.getCallsCount();
+				report.firstCall = latency.getFirstCall();
+				if (report.callsCount > 1)
+					report.steadyState = latency.getAverage();
+				result.push_back(std::move(report));
+			}
+		}
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::size_t Router::unregisterPlugin(const std::string& pluginName)
+	{
+		std::size_t result = 0;
+		waitForAttempts();
+
+		// Queued messages may dispatch through the router so workers
+		// are stopped before the registry is locked. Removed handlers
+		// then don't join any worker while the lock is held.
+		stopPluginMailboxes(pluginName);
+
+		{
+			std::unique_lock<std::shared_mutex> registryLock(m_registryMutex, std::defer_lock);
+			if (m_usageTracking)
+				registryLock.lock();
+
+			for (const auto& [info, collection] : m_handlers)
+			{
+				if (!collection)
+					continue;
+
+				const std::size_t removedCount = collection->removePlugin(pluginName);
+				if (removedCount > 0 && collection->getCache())
+					collection->getCache()->invalidate();
+				result += removedCount;
+			}
+
+			for (const auto& [info, collection] : m_receivers)
+				if (collection)
+					result += collection->removePlugin(pluginName);
+
+			m_registrationSequences.erase(pluginName);
+		}
+
+		std::lock_guard<std::recursive_mutex> lock(m_suspendedPluginsMutex);
+		const auto suspended = m_suspendedPlugins.find(pluginName);
+		if (suspended != m_suspendedPlugins.end())
+		{
+			for (const IntentInfo& info : suspended->second.intents)
+				--m_suspendedIntents.at(info);
+			for (const EventInfo& info : suspended->second.events)
+				--m_suspendedEvents.at(info);
+			m_suspendedPlugins.erase(suspended);
+			--m_suspendedPluginsCount;
+		}
+
+		return result;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool Router::suspendPlugin(const std::string& pluginName, const std::function<void(Router&)>& deinit, std::function<void(Router&)> loader)
+	{
+		assert(m_usageTracking);
+
+		const auto hasPlugin = [&pluginName](const std::vector<PluginInfo>& plugins)
+		{
+			return std::any_of(plugins.begin(), plugins.end(), [&pluginName](const PluginInfo& plugin) { return plugin.name == pluginName; });
+		};
+
+		SuspendedPlugin suspended{ std::move(loader), {}, {} };
+		{
+			std::shared_lock<std::shared_mutex> registryLock(m_registryMutex);
+			for (const auto& [info, collection] : m_handlers)
+				if (collection && hasPlugin(collection->getPluginsInfo()))
+					suspended.intents.push_back(info);
+			for (const auto& [info, collection] : m_receivers)
+				if (collection && hasPlugin(collection->getPluginsInfo()))
+					suspended.events.push_back(info);
+		}
+
+		if (suspended.intents.empty() && suspended.events.empty())
+			return false;
+
+		deinit(*this);
+		waitForAttempts();
+		stopPluginMailboxes(pluginName); // before locking, see 'unregisterPlugin'
+
+		// Collections created by the plugin's code would outlive its 
+		// library so they are dropped if they're empty or recreated by
+		// the code of a plugin that stays loaded.
+		{
+			std::unique_lock<std::shared_mutex> registryLock(m_registryMutex);
+			for (const IntentInfo& info : suspended.intents)
+			{
+				std::unique_ptr<HandlersCollectionBase>& collection = m_handlers[info];
+				collection->removePlugin(pluginName);
+				if (collection->getPluginsInfo().empty())
+					collection = nullptr;
+				else
+				{
+					collection = collection->relocate();
+					if (collection->getCache())
+						collection->getCache()->invalidate();
+				}
+			}
+			for (const EventInfo& info : suspended.events)
+			{
+				std::unique_ptr<ReceiversCollectionBase>& collection = m_receivers[info];
+				collection->removePlugin(pluginName);
+				collection = collection->getPluginsInfo().empty() ? nullptr : collection->relocate();
+			}
+		}
+
+		std::lock_guard<std::recursive_mutex> lock(m_suspendedPluginsMutex);
+		for (const IntentInfo& info : suspended.intents)
+			++m_suspendedIntents[info];
+		for (const EventInfo& info : suspended.events)
+			++m_suspendedEvents[info];
+		m_suspendedPlugins[pluginName] = std::move(suspended);
+		++m_suspendedPluginsCount;
+		return true;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename Info>
+	inline void Router::resumePlugins(const Info& info, const std::map<Info, std::atomic<int>>& suspendedCounts)
+	{
+		const auto count = suspendedCounts.find(info);
+		if (count == suspendedCounts.end() || count->second.load() == 0)
+			return;
+
+		// Recursive because plugins may dispatch intents of other 
+		// suspended plugins during their initialization. Other threads
+		// that need any of these plugins wait here.
+		std::lock_guard<std::recursive_mutex> lock(m_suspendedPluginsMutex);
+		for (auto it = m_suspendedPlugins.begin(); it != m_suspendedPlugins.end(); )
+		{
+			const auto& infos = [&it]() -> const std::vector<Info>&
+			{
+				if constexpr (std::is_same_v<Info, IntentInfo>)
+					return it->second.intents;
+				else
+					return it->second.events;
+			}();
+			if (std::find(infos.begin(), infos.end(), info) == infos.end())
+			{
+				++it;
+				continue;
+			}
+
+			const std::string pluginName = it->first;
+			SuspendedPlugin suspended = std::move(it->second);
+			m_suspendedPlugins.erase(it);
+
+			const std::string reloadedPlugin = std::exchange(m_reloadedPlugin, pluginName);
+			const std::size_t reloadedRegistrationsCount = std::exchange(m_reloadedRegistrationsCount, 0);
+			suspended.loader(*this);
+			m_reloadedPlugin = reloadedPlugin;
+			m_reloadedRegistrationsCount = reloadedRegistrationsCount;
+
+			// dispatching reads the collections without the lock after 
+			// it sees the counters drop
+			for (const IntentInfo& intent : suspended.intents)
+				--m_suspendedIntents.at(intent);
+			for (const EventInfo& event : suspended.events)
+				--m_suspendedEvents.at(event);
+			--m_suspendedPluginsCount;
+
+			it = m_suspendedPlugins.begin();
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Router::waitForAttempts()
+	{
+		// attempts are tasks of the pool so the waiter is woken up 
+		// when they finish
+		if (m_threadPool)
+			m_threadPool->waitUntil([this] { return m_pendingAttemptsCount.load() == 0; });
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename Map>
+	inline typename Map::mapped_type::pointer Router::findCollection(const Map& collections, const typename Map::key_type& info) const
+	{
+		std::shared_lock<std::shared_mutex> lock(m_registryMutex, std::defer_lock);
+		if (m_usageTracking)
+			lock.lock();
+
+		const auto it = collections.find(info);
+		return it != collections.end() ? it->second.get() : nullptr;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::shared_ptr<PluginUsage> Router::addPluginUsage(const std::string& pluginName)
+	{
+		if (!m_usageTracking)
+			return nullptr;
+
+		std::unique_lock<std::shared_mutex> lock(m_registryMutex);
+		std::shared_ptr<PluginUsage>& usage = m_usages[pluginName];
+		if (!usage)
+			usage = m_createUsage();
+		return usage;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::uint64_t Router::getRegistrationSequence(const std::string& pluginName)
+	{
+		if (!m_usageTracking)
+			return m_nextSequence++;
+
+		std::unique_lock<std::shared_mutex> lock(m_registryMutex);
+		std::vector<std::uint64_t>& sequences = m_registrationSequences[pluginName];
+		if (pluginName == m_reloadedPlugin && m_reloadedRegistrationsCount < sequences.size())
+			return sequences[m_reloadedRegistrationsCount++];
+
+		sequences.push_back(m_nextSequence++);
+		return sequences.back();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::shared_ptr<Mailbox> Router::getPluginMailbox(const std::string& pluginName)
+	{
+		if (!m_actorOptions)
+			return nullptr;
+
+		std::unique_lock<std::shared_mutex> lock(m_registryMutex, std::defer_lock);
+		if (m_usageTracking)
+			lock.lock();
+
+		std::shared_ptr<Mailbox>& mailbox = m_mailboxes[pluginName];
+		if (!mailbox)
+			mailbox = createMailbox();
+		return mailbox;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::shared_ptr<Mailbox> Router::createMailbox()
+	{
+		std::optional<unsigned> core;
+		if (m_actorOptions && m_actorOptions->pinToCores)
+			core = (m_actorOptions->firstCore + m_nextCore++) % std::max(1u, std::thread::hardware_concurrency());
+		return m_createMailbox(core);
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Router::stopPluginMailboxes(const std::string& pluginName)
+	{
+		std::vector<std::shared_ptr<Mailbox>> mailboxes;
+		{
+			std::unique_lock<std::shared_mutex> lock(m_registryMutex, std::defer_lock);
+			if (m_usageTracking)
+				lock.lock();
+
+			const auto mailbox = m_mailboxes.find(pluginName);
+			if (mailbox != m_mailboxes.end())
+			{
+				mailboxes.push_back(std::move(mailbox->second));
+				m_mailboxes.erase(mailbox);
+			}
+
+			const auto shards = m_shardMailboxes.find(pluginName);
+			if (shards != m_shardMailboxes.end())
+			{
+				mailboxes.insert(mailboxes.end(), shards->second.begin(), shards->second.end());
+				m_shardMailboxes.erase(shards);
+			}
+		}
+
+		// messages may dispatch through the router so the lock mustn't
+		// be held while waiting for the workers
+		for (const std::shared_ptr<Mailbox>& mailbox : mailboxes)
+			mailbox->stop();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template<typename T>
+	inline void Router::postEvent(T event)
+	{
+		std::lock_guard<std::mutex> lock(m_postedEventsMutex);
+
+		// only a few event types are posted within one window so the 
+		// linear search is cheaper than a map lookup
+		PostedEvents<T>* queue = nullptr;
+		for (const std::unique_ptr<PostedEventsBase>& posted : m_postedEvents)
+			if (posted->getEventInfo() == T::Info)
+				queue = static_cast<PostedEvents<T>*>(posted.get());
+
+		if (!queue)
+		{
+			auto newQueue = std::make_unique<PostedEvents<T>>();
+			queue = newQueue.get();
+			m_postedEvents.push_back(std::move(newQueue));
+		}
+
+		CoalescingStats& stats = m_coalescingStats[T::Info];
+		++stats.postedCount;
+		if (queue->push(std::move(event)))
+			++stats.coalescedCount;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void Router::dispatchPostedEvents()
+	{
+		std::vector<std::unique_ptr<PostedEventsBase>> postedEvents;
+		{
+			std::lock_guard<std::mutex> lock(m_postedEventsMutex);
+			postedEvents.swap(m_postedEvents);
+		}
+
+		for (const std::unique_ptr<PostedEventsBase>& posted : postedEvents)
+		{
+			CoalescingStats dispatched;
+			posted->dispatch(*this, dispatched);
+
+			std::lock_guard<std::mutex> lock(m_postedEventsMutex);
+			CoalescingStats& stats = m_coalescingStats[posted->getEventInfo()];
+			stats.dispatchedCount += dispatched.dispatchedCount;
+			stats.deliveriesCount += dispatched.deliveriesCount;
+			stats.savedDeliveriesCount += dispatched.savedDeliveriesCount;
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline void PostedEvents<T>::dispatch(Router& router, CoalescingStats& stats)
+	{
+		for (std::size_t i = 0; i < m_events.size(); ++i)
+		{
+			// receivers skipped after the event was consumed have no result
+			std::size_t deliveriesCount = 0;
+			for (const auto& result : router.processEvent(m_events[i]))
+				deliveriesCount += result.has_value() ? 1 : 0;
+			++stats.dispatchedCount;
+			stats.deliveriesCount += deliveriesCount;
+			stats.savedDeliveriesCount += m_coalescedCounts[i] * deliveriesCount;
+		}
+	}
+
 } // namespace pp
\ No newline at end of file
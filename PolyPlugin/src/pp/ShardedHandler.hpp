@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <pp/Mailbox.hpp>
+#include <pp/PluginUsage.hpp>
+
+namespace pp
+{
+	//-------------------------------------------------------------------------------------------------------
+	// Intent types processed by sharded handlers (see
+	// Router::registerShardedIntentHandler) provide a static function
+	// returning a key with std::hash specialization:
+	//		static KeyType partitionKey(const IntentType& intent);
+	// Intents with equal keys are always processed by the same shard.
+	// They're processed in order of dispatching only if they're
+	// dispatched from a single thread, concurrent dispatches of one key
+	// are processed in the order they reach the shard's mailbox.
+	template <typename T, typename = void>
+	struct IsPartitioned : std::false_type {};
+
+	template <typename T>
+	struct IsPartitioned<T, std::void_t<decltype(T::partitionKey(std::declval<const T&>()))>> : std::true_type {};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Maps hashes of keys to nodes. Every node owns many points (virtual
+	// nodes) on a ring of 64-bit hashes and a key belongs to the node
+	// owning the first point after the key's hash. Keys are spread
+	// evenly and if the number of nodes changes only about 1/N of the
+	// keys move to another node.
+	class ConsistentHashRing final
+	{
+	public:
+		// @param nodesCount - number of nodes, at least 1
+		// @param virtualNodesCount - points per node, more points
+		//		spread the keys more evenly
+		ConsistentHashRing(std::size_t nodesCount, std::size_t virtualNodesCount = 128);
+
+		// @returns index of the node owning the hash
+		// @param hash - hash of the key, it doesn't need to be well
+		//		distributed since it's mixed first
+		std::size_t getNode(std::uint64_t hash) const;
+
+		// @returns number of nodes
+		std::size_t getNodesCount() const { return m_nodesCount; }
+
+	private:
+		// splitmix64 finalizer, std::hash of integers is usually the
+		// identity which would put consecutive keys next to each other
+		static std::uint64_t mix(std::uint64_t value)
+		{
+			value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+			value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+			return value ^ (value >> 31);
+		}
+
+		std::size_t m_nodesCount = 0;
+		std::vector<std::pair<std::uint64_t, std::uint32_t>> m_points; // sorted by hash
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Family of instances of one intent handler. Each instance (shard)
+	// has its own mailbox so shards run in parallel while a single
+	// shard is never called concurrently and keeps its state without
+	// locks. Intents are routed to shards by their partition key, the
+	// order per key is kept for a single dispatching thread only.
+	// @tparam T - partitioned intent type
+	template <typename T>
+	class ShardedIntentHandler final
+	{
+	public:
+		using Handler = std::function<typename T::Result(T)>;
+
+		// @param handlers - handler of every shard
+		// @param mailboxes - mailbox of every shard, indices match
+		// @param usage - usage of the plugin, may be null
+		ShardedIntentHandler(std::vector<Handler> handlers, std::vector<std::shared_ptr<Mailbox>> mailboxes, std::shared_ptr<PluginUsage> usage);
+
+		// Processes the intent on the worker of its shard and waits
+		// for the result.
+		typename T::Result operator()(T intent) const;
+
+		// @returns index of the shard processing intents with given key
+		// @param intent - intent to route
+		std::size_t getShard(const T& intent) const;
+
+		// @returns number of shards
+		std::size_t getShardsCount() const { return m_handlers.size(); }
+
+	private:
+		ConsistentHashRing m_ring;
+		std::vector<Handler> m_handlers;
+		std::vector<std::shared_ptr<Mailbox>> m_mailboxes;
+		std::shared_ptr<PluginUsage> m_usage;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	inline ConsistentHashRing::ConsistentHashRing(std::size_t nodesCount, std::size_t virtualNodesCount)
+		: m_nodesCount(std::max<std::size_t>(1, nodesCount))
+	{
+		virtualNodesCount = std::max<std::size_t>(1, virtualNodesCount);
+		m_points.reserve(m_nodesCount * virtualNodesCount);
+		for (std::size_t node = 0; node < m_nodesCount; ++node)
+			for (std::size_t point = 0; point < virtualNodesCount; ++point)
+				m_points.emplace_back(mix((static_cast<std::uint64_t>(node) << 32) | point), static_cast<std::uint32_t>(node));
+		std::sort(m_points.begin(), m_points.end());
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::size_t ConsistentHashRing::getNode(std::uint64_t hash) const
+	{
+		// the increment keeps small keys from hitting the points of
+		// the first node, they are mixed from (node << 32 | point)
+		const std::uint64_t position = mix(hash + 0x9E3779B97F4A7C15ull);
+		const auto it = std::lower_bound(m_points.begin(), m_points.end(), position,
+			[](const std::pair<std::uint64_t, std::uint32_t>& point, std::uint64_t value) { return point.first < value; });
+		return it != m_points.end() ? it->second : m_points.front().second;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline ShardedIntentHandler<T>::ShardedIntentHandler(std::vector<Handler> handlers, std::vector<std::shared_ptr<Mailbox>> mailboxes, std::shared_ptr<PluginUsage> usage)
+		: m_ring(handlers.size()), m_handlers(std::move(handlers)), m_mailboxes(std::move(mailboxes)), m_usage(std::move(usage))
+	{
+		static_assert(IsPartitioned<T>::value, "Sharded intent handlers require intent with static partitionKey function");
+		assert(!m_handlers.empty() && m_handlers.size() == m_mailboxes.size());
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline std::size_t ShardedIntentHandler<T>::getShard(const T& intent) const
+	{
+		using Key = std::decay_t<decltype(T::partitionKey(intent))>;
+		return m_ring.getNode(static_cast<std::uint64_t>(std::hash<Key>{}(T::partitionKey(intent))));
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename T>
+	inline typename T::Result ShardedIntentHandler<T>::operator()(T intent) const
+	{
+		const std::size_t shard = getShard(intent);
+		return m_mailboxes[shard]->call([&]
+		{
+			PluginUsage::Scope scope(m_usage.get());
+			return m_handlers[shard](std::move(intent));
+		});
+	}
+
+} // namespace pp
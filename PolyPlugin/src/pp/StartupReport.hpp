@@ -0,0 +1,204 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <filesystem>
+
+#include <pp/Info.hpp>
+
+namespace pp
+{
+	//-------------------------------------------------------------------------------------------------------
+	// Outcome of loading a single shared library.
+	enum class ePluginLoadStatus
+	{
+		INITIALIZED,
+		LIBRARY_LOAD_FAILED,
+		ENTRY_POINT_MISSING,
+		VERSION_MISMATCH
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Timing breakdown of loading one plugin. Phases that weren't
+	// reached (e.g. init of a plugin with mismatched version) are zero.
+	class PluginLoadReport
+	{
+	public:
+		std::filesystem::path path;
+		ePluginLoadStatus status = ePluginLoadStatus::LIBRARY_LOAD_FAILED;
+
+		// filled only if the plugin was created with a compatible
+		// PolyPlugin version
+		std::string name;
+		Version version;
+
+		// dlopen/LoadLibrary, includes relocations and static
+		// initializers of the library since the OS runs both inside
+		// of this call
+		std::chrono::nanoseconds libraryLoadTime{ 0 };
+		// lookup of 'createPolyPlugin' symbol
+		std::chrono::nanoseconds entryPointLookupTime{ 0 };
+		// call to 'createPolyPlugin'
+		std::chrono::nanoseconds createTime{ 0 };
+		// call to IPlugin::init
+		std::chrono::nanoseconds initTime{ 0 };
+
+		// size of the library image mapped into the process, zero if
+		// it couldn't be determined on this platform
+		std::size_t mappedSize = 0;
+		// number of intent handlers and event receivers registered in
+		// IPlugin::init
+		std::size_t handlersCount = 0;
+		std::size_t receiversCount = 0;
+
+		// filled by PluginsContainer::warmUp, not included in the 
+		// total time
+		std::chrono::nanoseconds warmUpTime{ 0 };
+		std::size_t prefaultedSize = 0;
+		std::size_t lockedSize = 0;
+
+		// @returns time spent on loading this plugin
+		std::chrono::nanoseconds getTotalTime() const { return libraryLoadTime + entryPointLookupTime + createTime + initTime; }
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Startup profile gathered by PluginsContainer while loading
+	// plugins. It's meant to find out which plugins (and which phase
+	// of loading them) make the startup slow.
+	class StartupReport
+	{
+	public:
+		// time spent on searching directories for shared libraries
+		std::chrono::nanoseconds scanTime{ 0 };
+		std::vector<PluginLoadReport> plugins;
+
+		// @returns report of the plugin loaded from the given path or
+		//		nullptr if there is no such report
+		PluginLoadReport* find(const std::filesystem::path& path)
+		{
+			return const_cast<PluginLoadReport*>(static_cast<const StartupReport&>(*this).find(path));
+		}
+		const PluginLoadReport* find(const std::filesystem::path& path) const;
+
+		// @returns the whole report serialized as JSON
+		std::string toJson() const;
+
+		// Writes the JSON report to a file.
+		// @returns true if the file was written successfully
+		// @param path - path of the file to write
+		bool saveJson(const std::filesystem::path& path) const;
+	};
+
+	//-------------------------------------------------------------------------------------------------------
+	inline const PluginLoadReport* StartupReport::find(const std::filesystem::path& path) const
+	{
+		// the latest report wins if the same library was loaded twice
+		for (auto it = plugins.rbegin(); it != plugins.rend(); ++it)
+			if (it->path == path)
+				return &*it;
+		return nullptr;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline std::string StartupReport::toJson() const
+	{
+		const auto quote = [](const std::string& text)
+		{
+			std::ostringstream stream;
+			stream << '"';
+			for (const char c : text)
+			{
+				switch (c)
+				{
+				case '"': stream << "\\\""; break;
+				case '\\': stream << "\\\\"; break;
+				case '\n': stream << "\\n"; break;
+				case '\r': stream << "\\r"; break;
+				case '\t': stream << "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20)
+						stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+					else
+						stream << c;
+				}
+			}
+			stream << '"';
+			return stream.str();
+		};
+
+		const auto milliseconds = [](std::chrono::nanoseconds time)
+		{
+			std::ostringstream stream;
+			stream << std::fixed << std::setprecision(3) << std::chrono::duration<double, std::milli>(time).count();
+			return stream.str();
+		};
+
+		const auto statusName = [](ePluginLoadStatus status)
+		{
+			switch (status)
+			{
+			case ePluginLoadStatus::INITIALIZED: return "initialized";
+			case ePluginLoadStatus::LIBRARY_LOAD_FAILED: return "library_load_failed";
+			case ePluginLoadStatus::ENTRY_POINT_MISSING: return "entry_point_missing";
+			case ePluginLoadStatus::VERSION_MISMATCH: return "version_mismatch";
+			}
+			return "unknown";
+		};
+
+		std::chrono::nanoseconds totalTime = scanTime;
+		for (const PluginLoadReport& plugin : plugins)
+			totalTime += plugin.getTotalTime();
+
+		std::ostringstream json;
+		json << "{\n";
+		json << "\t\"totalMs\": " << milliseconds(totalTime) << ",\n";
+		json << "\t\"scanMs\": " << milliseconds(scanTime) << ",\n";
+		json << "\t\"plugins\": [";
+		for (std::size_t i = 0; i < plugins.size(); ++i)
+		{
+			const PluginLoadReport& plugin = plugins[i];
+			json << (i == 0 ? "\n" : ",\n");
+			json << "\t\t{\n";
+			json << "\t\t\t\"path\": " << quote(plugin.path.string()) << ",\n";
+			json << "\t\t\t\"status\": \"" << statusName(plugin.status) << "\",\n";
+			json << "\t\t\t\"name\": " << quote(plugin.name) << ",\n";
+			json << "\t\t\t\"version\": \"" << plugin.version.major << "." << plugin.version.minor << "." << plugin.version.patch << "\",\n";
+			json << "\t\t\t\"totalMs\": " << milliseconds(plugin.getTotalTime()) << ",\n";
+			json << "\t\t\t\"libraryLoadMs\": " << milliseconds(plugin.libraryLoadTime) << ",\n";
+			json << "\t\t\t\"entryPointLookupMs\": " << milliseconds(plugin.entryPointLookupTime) << ",\n";
+			json << "\t\t\t\"createMs\": " << milliseconds(plugin.createTime) << ",\n";
+			json << "\t\t\t\"initMs\": " << milliseconds(plugin.initTime) << ",\n";
+			json << "\t\t\t\"mappedBytes\": " << plugin.mappedSize << ",\n";
+			json << "\t\t\t\"handlers\": " << plugin.handlersCount << ",\n";
+			json << "\t\t\t\"receivers\": " << plugin.receiversCount << ",\n";
+			json << "\t\t\t\"warmUpMs\": " << milliseconds(plugin.warmUpTime) << ",\n";
+			json << "\t\t\t\"prefaultedBytes\": " << plugin.prefaultedSize << ",\n";
+			json << "\t\t\t\"lockedBytes\": " << plugin.lockedSize << "\n";
+			json << "\t\t}";
+		}
+		json << (plugins.empty() ? "]\n" : "\n\t]\n");
+		json << "}\n";
+
+		return json.str();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool StartupReport::saveJson(const std::filesystem::path& path) const
+	{
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file << toJson();
+		return static_cast<bool>(file);
+	}
+
+} // namespace pp
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <pp/Defines.hpp>
+
+namespace pp
+{
+	class IPlugin;
+	// Helper using statement to simplify usage of type of a function
+	// that is loaded from the shared library and provides instance of
+	// IPlugin.
+	using PluginCreatorType = IPlugin* STDCALL_CAST ();
+
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Registry of plugins linked directly into the host executable.
+	// If a plugin is compiled with PP_STATIC_PLUGIN defined its
+	// POLY_PLUGIN_ENTRY adds the plugin here during static
+	// initialization instead of exporting 'createPolyPlugin'.
+	// PluginsContainer::loadStatic creates and initializes them the
+	// same way as plugins loaded from shared libraries.
+	class StaticPluginsRegistry
+	{
+	public:
+		class Entry
+		{
+		public:
+			std::string name;
+			PluginCreatorType creator = nullptr;
+		};
+
+		// Adds the plugin to the registry. Used by POLY_PLUGIN_ENTRY.
+		// Plugins are identified by their index in the registry so 
+		// several entries may have the same name, registering the 
+		// same creator again is rejected.
+		// @returns true if the plugin was added, false if its creator
+		//		is already registered
+		// @param name - name of the plugin class
+		// @param creator - function creating the plugin instance
+		static bool add(std::string name, PluginCreatorType creator)
+		{
+			std::vector<Entry>& entries = getMutableEntries();
+			if (!creator || std::any_of(entries.begin(), entries.end(), [creator](const Entry& entry) { return entry.creator == creator; }))
+				return false;
+
+			entries.push_back({ std::move(name), creator });
+			return true;
+		}
+
+		// @returns all plugins linked into the executable
+		static const std::vector<Entry>& getEntries() { return getMutableEntries(); }
+
+	private:
+		// function-local static so registering from static
+		// initializers of other translation units is safe
+		static std::vector<Entry>& getMutableEntries()
+		{
+			static std::vector<Entry> entries;
+			return entries;
+		}
+	}; // class StaticPluginsRegistry
+
+} // namespace pp
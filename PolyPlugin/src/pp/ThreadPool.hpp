@@ -0,0 +1,284 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+namespace pp
+{
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	//-------------------------------------------------------------------------------------------------------
+	// Work-stealing thread pool used by the Router to run independent
+	// handlers concurrently. Every worker owns a task queue; tasks
+	// submitted from a worker go to its own queue (and are popped in
+	// LIFO order so the data they touch is still hot), tasks submitted
+	// from other threads are spread round-robin. Idle workers steal the
+	// oldest tasks from the other queues.
+	class ThreadPool final
+	{
+	public:
+		// @param threadsCount - number of worker threads, by default
+		//		one per hardware thread
+		ThreadPool(std::size_t threadsCount = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Schedules a task for execution. Tasks must not throw.
+		// @param task - task to execute on one of the workers
+		// @param pendingCount - counter decremented once the task is
+		//		executed and destroyed, may be null. Waiting for it lets
+		//		the caller unload the library that the task came from.
+		void submit(std::function<void()> task, std::atomic<std::size_t>* pendingCount = nullptr);
+
+		// Blocks the calling thread until 'done' returns true. While
+		// waiting the calling thread executes pending tasks so it is
+		// safe to wait from inside of a task (nested dispatching).
+		// @param done - predicate checked between executed tasks, it
+		//		may only become true by tasks of this pool since the
+		//		waiter is woken up when they finish
+		template <typename Predicate>
+		void waitUntil(Predicate done);
+
+		// Same as the above but gives up at the deadline. A task 
+		// executed while waiting may still delay the return past it.
+		// @returns true if 'done' returned true before the deadline
+		// @param done - predicate checked between executed tasks
+		// @param deadline - time after which the waiting stops
+		template <typename Predicate>
+		bool waitUntil(Predicate done, std::chrono::steady_clock::time_point deadline);
+
+		// @returns true if called from one of the workers of this pool
+		bool isWorkerThread() const { return s_currentPool == this; }
+
+		// @returns number of worker threads
+		std::size_t getThreadsCount() const { return m_threads.size(); }
+
+	private:
+		struct Task
+		{
+			std::function<void()> function;
+			std::atomic<std::size_t>* pendingCount = nullptr;
+		};
+
+		struct WorkerQueue
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		template <typename Predicate>
+		bool wait(Predicate done, const std::chrono::steady_clock::time_point* deadline);
+
+		bool tryPopTask(Task& task);
+		void runTask(Task& task);
+		void workerLoop(std::size_t index);
+
+		std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+		std::vector<std::thread> m_threads;
+
+		std::mutex m_sleepMutex;
+		std::condition_variable m_tasksAvailable;
+		std::condition_variable m_taskFinished;
+		std::atomic<std::size_t> m_pendingCount = 0;
+		std::atomic<std::size_t> m_waitersCount = 0;
+		std::atomic<std::size_t> m_nextQueue = 0;
+		bool m_stop = false;
+
+		// Identifies the pool and the queue owned by the current thread
+		// so tasks submitted by workers stay local.
+		static inline thread_local ThreadPool* s_currentPool = nullptr;
+		static inline thread_local std::size_t s_currentQueue = 0;
+	}; // class ThreadPool
+
+	//-------------------------------------------------------------------------------------------------------
+	inline ThreadPool::ThreadPool(std::size_t threadsCount)
+	{
+		if (threadsCount == 0)
+			threadsCount = 1;
+
+		for (std::size_t i = 0; i < threadsCount; ++i)
+			m_queues.push_back(std::make_unique<WorkerQueue>());
+		for (std::size_t i = 0; i < threadsCount; ++i)
+			m_threads.emplace_back([this, i] { workerLoop(i); });
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stop = true;
+		}
+		m_tasksAvailable.notify_all();
+
+		for (std::thread& thread : m_threads)
+			thread.join();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void ThreadPool::submit(std::function<void()> task, std::atomic<std::size_t>* pendingCount)
+	{
+		const std::size_t queueIndex = s_currentPool == this
+			? s_currentQueue
+			: m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+		// Counted before it's queued, a worker may pop and finish the
+		// task before this thread returns from the push and the count
+		// mustn't drop below zero meanwhile. Workers seeing the count
+		// before the push just retry.
+		m_pendingCount.fetch_add(1, std::memory_order_release);
+		{
+			WorkerQueue& queue = *m_queues[queueIndex];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back({ std::move(task), pendingCount });
+		}
+
+		// Taking the lock prevents a worker from missing the
+		// notification between checking the predicate and sleeping.
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_tasksAvailable.notify_one();
+
+		// workers blocked in waitUntil sleep on the other condition and
+		// have to be woken up to help with the new task
+		if (m_waitersCount.load() > 0)
+			m_taskFinished.notify_all();
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename Predicate>
+	inline void ThreadPool::waitUntil(Predicate done)
+	{
+		wait(done, nullptr);
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename Predicate>
+	inline bool ThreadPool::waitUntil(Predicate done, std::chrono::steady_clock::time_point deadline)
+	{
+		return wait(done, &deadline);
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	template <typename Predicate>
+	inline bool ThreadPool::wait(Predicate done, const std::chrono::steady_clock::time_point* deadline)
+	{
+		Task task;
+		while (!done())
+		{
+			if (deadline && std::chrono::steady_clock::now() >= *deadline)
+				return false;
+
+			if (tryPopTask(task))
+			{
+				runTask(task);
+				continue;
+			}
+
+			// Waiters are woken up whenever a task finishes or is
+			// submitted. Registering before checking the predicate
+			// makes sure either the check or the notifier sees the
+			// other side's change.
+			m_waitersCount.fetch_add(1);
+			{
+				std::unique_lock<std::mutex> lock(m_sleepMutex);
+				if (!done() && m_pendingCount.load() == 0)
+				{
+					if (deadline)
+						m_taskFinished.wait_until(lock, *deadline);
+					else
+						m_taskFinished.wait(lock);
+				}
+			}
+			m_waitersCount.fetch_sub(1);
+		}
+		return true;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline bool ThreadPool::tryPopTask(Task& task)
+	{
+		if (m_pendingCount.load(std::memory_order_acquire) == 0)
+			return false;
+
+		const bool isWorker = s_currentPool == this;
+		const std::size_t start = isWorker ? s_currentQueue : 0;
+
+		for (std::size_t i = 0; i < m_queues.size(); ++i)
+		{
+			const std::size_t index = (start + i) % m_queues.size();
+			WorkerQueue& queue = *m_queues[index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+
+			// own queue is used as a stack, the others are robbed from
+			// the opposite end
+			if (isWorker && index == s_currentQueue)
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+
+			m_pendingCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		return false;
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void ThreadPool::runTask(Task& task)
+	{
+		task.function();
+		task.function = nullptr;
+		if (task.pendingCount)
+			task.pendingCount->fetch_sub(1);
+
+		if (m_waitersCount.load() > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+			}
+			m_taskFinished.notify_all();
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------------------
+	inline void ThreadPool::workerLoop(std::size_t index)
+	{
+		s_currentPool = this;
+		s_currentQueue = index;
+
+		Task task;
+		while (true)
+		{
+			if (tryPopTask(task))
+			{
+				runTask(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_tasksAvailable.wait(lock, [this] { return m_stop || m_pendingCount.load() > 0; });
+			if (m_stop)
+				return;
+		}
+	}
+
+} // namespace pp
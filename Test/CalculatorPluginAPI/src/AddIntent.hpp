@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include <pp/Info.hpp>
 
 //------------------------------------------------------------------------------------------------------------------------------------------
@@ -9,6 +11,9 @@ public:
 	using Result = int;
 	static inline pp::IntentInfo Info = { "AddIntent", 3 };
 
+	// result depends only on the fields so it can be cached
+	static std::uint64_t cacheKey(const AddIntent& intent) { return (std::uint64_t(std::uint32_t(intent.a)) << 32) | std::uint32_t(intent.b); }
+
 	int a = 0;
 	int b = 0;
 };
\ No newline at end of file
@@ -0,0 +1,749 @@
+#include <FeatureChecks.hpp>
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+
+#include <pp/PolyPlugin.hpp>
+#include <AddIntent.hpp>
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static int s_failedChecksCount = 0;
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void check(const char* name, bool passed)
+{
+	std::cout << (passed ? "[ OK ] " : "[FAIL] ") << name << std::endl;
+	if (!passed)
+		++s_failedChecksCount;
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class FrameEvent
+{
+public:
+	using Result = bool;
+	static inline pp::EventInfo Info = { "FrameEvent", 1 };
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkReceiversOrder()
+{
+	pp::Router router(std::make_shared<pp::Selector>(), std::make_shared<pp::ThreadPool>(4));
+
+	std::mutex orderMutex;
+	std::vector<std::string> order;
+	const auto createReceiver = [&](std::string name)
+	{
+		return std::function<bool(const FrameEvent&)>([&, name](const FrameEvent&)
+		{
+			std::lock_guard<std::mutex> lock(orderMutex);
+			order.push_back(name);
+			return true;
+		});
+	};
+
+	// registered in reverse order, the last constraint closes a cycle
+	router.registerEventReceiver<FrameEvent>({ "Render", { 1, 0, 0 } }, createReceiver("Render"), pp::ReceiverOrder{ { "Physics" }, {} });
+	router.registerEventReceiver<FrameEvent>({ "Physics", { 1, 0, 0 } }, createReceiver("Physics"), pp::ReceiverOrder{ { "Input" }, {} });
+	router.registerEventReceiver<FrameEvent>({ "Input", { 1, 0, 0 } }, createReceiver("Input"), pp::ReceiverOrder{ { "Render" }, {} });
+
+	bool isOrdered = true;
+	for (int frame = 0; frame < 100; ++frame)
+	{
+		order.clear();
+		router.processEvent(FrameEvent{});
+		isOrdered = isOrdered && order == std::vector<std::string>{ "Input", "Physics", "Render" };
+	}
+	check("receivers run in dependency order on the thread pool", isOrdered);
+	check("constraint closing a cycle is ignored", router.getIgnoredReceiverConstraints(FrameEvent::Info).size() == 1);
+
+	// every receiver is a separate pool task, a miscounted task would
+	// make the pool wait forever or return early
+	std::atomic<int> independentCount = 0;
+	pp::Router independentRouter(std::make_shared<pp::Selector>(), std::make_shared<pp::ThreadPool>(4));
+	for (int i = 0; i < 8; ++i)
+		independentRouter.registerEventReceiver<FrameEvent>({ "Independent" + std::to_string(i), { 1, 0, 0 } }, [&independentCount](const FrameEvent&)
+		{
+			++independentCount;
+			return true;
+		});
+	for (int frame = 0; frame < 1000; ++frame)
+		independentRouter.processEvent(FrameEvent{});
+	check("independent receivers all finish before the dispatch returns", independentCount == 8000);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkStartupReport(const std::filesystem::path& pluginsPath)
+{
+	pp::PluginsContainer container;
+	container.load(pluginsPath, false);
+
+	const pp::StartupReport& report = container.getStartupReport();
+	const auto calculator = std::find_if(report.plugins.begin(), report.plugins.end(), [](const pp::PluginLoadReport& plugin) { return plugin.name == "Calculator"; });
+	if (calculator == report.plugins.end())
+		std::cout << "[SKIP] startup report of the calculator plugin, it isn't loaded dynamically" << std::endl;
+	else
+	{
+		const bool isProfiled = calculator->status == pp::ePluginLoadStatus::INITIALIZED && calculator->version.major == 1 && 
+			calculator->handlersCount == 1 && calculator->libraryLoadTime.count() > 0 && calculator->getTotalTime() >= calculator->initTime;
+		check("loaded plugin is profiled in the startup report", isProfiled && report.find(calculator->path) == &*calculator);
+
+		const std::string json = report.toJson();
+		check("startup report serializes the plugin to JSON", json.find("\"name\": \"Calculator\"") != std::string::npos && json.find("\"handlers\": 1") != std::string::npos);
+	}
+
+	// anything with the library extension of the platform is tried
+	const std::filesystem::path brokenPath = std::filesystem::temp_directory_path() / "PolyPluginBrokenPlugins";
+	std::filesystem::create_directories(brokenPath);
+	for (const char* extension : { ".so", ".dll", ".dylib" })
+		std::ofstream(brokenPath / (std::string("Broken") + extension)) << "not a library";
+
+	pp::PluginsContainer brokenContainer;
+	brokenContainer.load(brokenPath, false);
+	const pp::StartupReport& brokenReport = brokenContainer.getStartupReport();
+	const bool isFailed = brokenReport.plugins.size() == 1 && brokenReport.plugins[0].status == pp::ePluginLoadStatus::LIBRARY_LOAD_FAILED;
+	check("library that can't be loaded is reported", isFailed && brokenReport.toJson().find("\"status\": \"library_load_failed\"") != std::string::npos);
+	std::filesystem::remove_all(brokenPath);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class EntityMovedEvent
+{
+public:
+	using Result = bool;
+	static inline pp::EventInfo Info = { "EntityMovedEvent", 1 };
+	static int coalescingKey(const EntityMovedEvent& event) { return event.entity; }
+
+	int entity = 0;
+	int position = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkCoalescing()
+{
+	pp::Router router;
+
+	std::map<int, int> positions;
+	int deliveriesCount = 0;
+	router.registerEventReceiver<EntityMovedEvent>({ "Scene", { 1, 0, 0 } }, [&](const EntityMovedEvent& event)
+	{
+		positions[event.entity] = event.position;
+		++deliveriesCount;
+		return true;
+	});
+
+	for (int position = 0; position < 10; ++position)
+		for (int entity = 0; entity < 2; ++entity)
+			router.postEvent(EntityMovedEvent{ entity, position });
+	router.dispatchPostedEvents();
+
+	const pp::CoalescingStats stats = router.getCoalescingStats(EntityMovedEvent::Info);
+	check("posted events with equal keys are coalesced", deliveriesCount == 2 && stats.coalescedCount == 18 && stats.savedDeliveriesCount == 18);
+	check("the latest coalesced event wins", positions[0] == 9 && positions[1] == 9);
+
+	router.dispatchPostedEvents();
+	check("dispatched window is empty afterwards", deliveriesCount == 2);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class SquareIntent
+{
+public:
+	using Result = int;
+	static inline pp::IntentInfo Info = { "SquareIntent", 1 };
+	static int cacheKey(const SquareIntent& intent) { return intent.value; }
+
+	int value = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkIntentCache()
+{
+	pp::Router router;
+
+	int callsCount = 0;
+	router.registerIntentHandler<SquareIntent>({ "Square", { 1, 0, 0 } }, [&](SquareIntent intent)
+	{
+		++callsCount;
+		return intent.value * intent.value;
+	});
+
+	router.processIntent(SquareIntent{ 4 });
+	const bool isCached = *router.processIntent(SquareIntent{ 4 }) == 16 && callsCount == 1;
+	check("repeated cacheable intent doesn't call the handler", isCached && router.getIntentCacheStats(SquareIntent::Info).hitsCount == 1);
+
+	router.processIntent(SquareIntent{ 5 });
+	check("intents with other keys miss the cache", callsCount == 2 && router.getIntentCacheStats(SquareIntent::Info).missesCount == 2);
+
+	router.registerIntentHandler<SquareIntent>({ "OtherSquare", { 1, 0, 0 } }, [](SquareIntent intent) { return intent.value * intent.value; });
+	router.processIntent(SquareIntent{ 4 });
+	check("registering a handler invalidates the cache", callsCount == 3 && router.getIntentCacheStats(SquareIntent::Info).invalidationsCount > 0);
+
+	router.unregisterPlugin("Square");
+	check("unregistering the cached handler invalidates the cache", *router.processIntent(SquareIntent{ 4 }) == 16 && callsCount == 3);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class DepthIntent
+{
+public:
+	using Result = int;
+	static inline pp::IntentInfo Info = { "DepthIntent", 1 };
+
+	int depth = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+// Calls made by LifetimePlugin instances, set only while the lifetime
+// check runs so instances created by other containers aren't logged.
+static std::vector<std::string>* s_lifetimeLog = nullptr;
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+// Keeps only a plain reference to the router and dispatches through it
+// from its handler and from deinit.
+template <int Index>
+class LifetimePlugin : public pp::IPlugin
+{
+public:
+	~LifetimePlugin() override { log("destroyed"); }
+
+	void init(pp::Router& router) final
+	{
+		m_router = &router;
+		log("init");
+		router.registerIntentHandler<DepthIntent>(getPluginInfo(), [this](DepthIntent intent)
+		{
+			return intent.depth > 0 ? *m_router->processIntent(DepthIntent{ intent.depth - 1 }) + 1 : 0;
+		});
+	}
+
+	void deinit(pp::Router& router) final
+	{
+		const std::optional<int> depth = m_router->processIntent(DepthIntent{ 3 });
+		log("deinit " + std::to_string(router.getHandlersCount()) + " " + std::to_string(depth.value_or(-1)));
+	}
+
+	pp::PluginInfo getPluginInfo() const final { return { "Lifetime" + std::to_string(Index), { 1, 0, 0 } }; }
+
+	static pp::IPlugin* STDCALL create() { return new LifetimePlugin(); }
+
+private:
+	void log(const std::string& call) const
+	{
+		if (s_lifetimeLog)
+			s_lifetimeLog->push_back("Lifetime" + std::to_string(Index) + " " + call);
+	}
+
+	pp::Router* m_router = nullptr;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static const bool s_lifetimePluginsRegistered = pp::StaticPluginsRegistry::add("LifetimePlugin0", &LifetimePlugin<0>::create) && 
+	pp::StaticPluginsRegistry::add("LifetimePlugin1", &LifetimePlugin<1>::create);
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkHandleLifetimes()
+{
+	std::vector<std::string> log;
+	s_lifetimeLog = &log;
+	{
+		pp::PluginsContainer container;
+		container.loadStatic();
+		check("handler dispatches through the router reference it kept", *container.getRouter()->processIntent(DepthIntent{ 5 }) == 5);
+	}
+	s_lifetimeLog = nullptr;
+
+	// instances are owned by the container alone so both are gone once
+	// it's destroyed, after every deinit
+	const std::vector<std::string> expectedLog = { "Lifetime0 init", "Lifetime1 init", "Lifetime1 deinit 2 3", "Lifetime0 deinit 1 3" };
+	const bool isDeinitOrdered = s_lifetimePluginsRegistered && log.size() == 6 && std::equal(expectedLog.begin(), expectedLog.end(), log.begin());
+	check("plugins are deinitialized in reverse order while the router is alive", isDeinitOrdered);
+	check("plugins are destroyed with their container", std::count_if(log.begin(), log.end(), [](const std::string& call) { return call.find(" destroyed") != std::string::npos; }) == 2);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class LookupIntent
+{
+public:
+	using Result = int;
+	static inline pp::IntentInfo Info = { "LookupIntent", 1 };
+
+	int value = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkDeadlineFallback()
+{
+	// the default selector is used until the one observing the router
+	// is installed
+	auto router = std::make_shared<pp::Router>(nullptr, std::make_shared<pp::ThreadPool>(4));
+	router->registerIntentHandler<LookupIntent>({ "SlowLookup", { 1, 0, 0 } }, [](LookupIntent intent)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		return intent.value;
+	});
+	router->registerIntentHandler<LookupIntent>({ "FastLookup", { 1, 0, 0 } }, [](LookupIntent intent) { return intent.value; });
+	check("router created without a selector dispatches", *router->processIntent(LookupIntent{ 3 }) == 3);
+
+	const pp::DispatchResult<int> result = router->processIntentWithin(LookupIntent{ 7 }, std::chrono::milliseconds(100));
+	check("late handler falls back to the next one", result.status == pp::eDispatchStatus::SUCCESS && result.handlerIndex == 1 && *result.value == 7);
+
+	// the late attempt of the slow handler is measured once it finishes
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	router->setSelector(std::make_shared<pp::FastestHandlerSelector>(*router));
+	const pp::DispatchResult<int> fastest = router->processIntentWithin(LookupIntent{ 7 }, std::chrono::milliseconds(100));
+	check("fastest handler selector prefers the measured faster handler", fastest.status == pp::eDispatchStatus::SUCCESS && fastest.handlerIndex == 1);
+
+	pp::Router overloadedRouter;
+	overloadedRouter.registerIntentHandler<LookupIntent>({ "Busy", { 1, 0, 0 } }, [](LookupIntent) -> int { throw pp::HandlerOverloaded(); });
+	const pp::DispatchResult<int> overloaded = overloadedRouter.processIntentWithin(LookupIntent{ 7 }, std::chrono::milliseconds(100));
+	check("overloaded handler without fallback reports it", overloaded.status == pp::eDispatchStatus::OVERLOADED);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class GreetIntent
+{
+public:
+	using Result = std::string;
+	static inline pp::IntentInfo Info = { "GreetIntent", 1 };
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+// Stands for plugins of different source files that both name their
+// class 'Plugin', they're registered under the same name below.
+template <int Index>
+class StaticPlugin : public pp::IPlugin
+{
+public:
+	void init(pp::Router& router) final
+	{
+		router.registerIntentHandler<GreetIntent>(getPluginInfo(), [](GreetIntent) { return "Static" + std::to_string(Index); });
+	}
+
+	void deinit(pp::Router& /*router*/) final { }
+	pp::PluginInfo getPluginInfo() const final { return { "Static" + std::to_string(Index), { 1, 0, 0 } }; }
+
+	static pp::IPlugin* STDCALL create() { return new StaticPlugin(); }
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static const bool s_staticPluginsRegistered = pp::StaticPluginsRegistry::add("Plugin", &StaticPlugin<0>::create) && 
+	pp::StaticPluginsRegistry::add("Plugin", &StaticPlugin<1>::create);
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkStaticPlugins()
+{
+	check("static entry point can't be registered twice", s_staticPluginsRegistered && !pp::StaticPluginsRegistry::add("Plugin", &StaticPlugin<0>::create));
+
+	pp::PluginsContainer container;
+	container.getRouter()->enableUsageTracking();
+	const std::vector<std::weak_ptr<pp::PluginWrapper>> plugins = container.loadStatic();
+	check("static plugins are loaded only once per container", !plugins.empty() && container.loadStatic().empty());
+
+	std::vector<std::filesystem::path> paths;
+	for (const pp::PluginLoadReport& report : container.getStartupReport().plugins)
+		if ((report.name == "Static0" || report.name == "Static1") && report.status == pp::ePluginLoadStatus::INITIALIZED)
+			paths.push_back(report.path);
+	check("static plugins with equal class names get their own reports", paths.size() == 2 && paths[0] != paths[1]);
+
+	std::vector<std::string> names;
+	for (const pp::PluginMemoryReport& report : container.getMemoryReport())
+		if (report.name == "Static0" || report.name == "Static1")
+			names.push_back(report.name);
+	std::sort(names.begin(), names.end());
+	const bool isToldApart = names == std::vector<std::string>{ "Static0", "Static1" };
+	check("static plugins with equal class names are told apart", isToldApart && *container.getRouter()->processIntent(GreetIntent{}) == "Static0");
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkActorExecution()
+{
+	pp::Router router;
+	router.enableActorExecution();
+
+	// the counters aren't synchronized, every plugin runs on its own mailbox
+	std::map<std::string, std::pair<int, std::thread::id>> plugins;
+	bool isSingleThreaded = true;
+	for (const char* name : { "First", "Second" })
+	{
+		auto& [callsCount, threadId] = plugins[name];
+		router.registerIntentHandler<LookupIntent>({ name, { 1, 0, 0 } }, [&callsCount = callsCount, &threadId = threadId, &isSingleThreaded](LookupIntent intent)
+		{
+			if (threadId == std::thread::id())
+				threadId = std::this_thread::get_id();
+			isSingleThreaded = isSingleThreaded && threadId == std::this_thread::get_id();
+			++callsCount;
+			return intent.value;
+		});
+	}
+
+	std::vector<std::thread> dispatchers;
+	for (int i = 0; i < 4; ++i)
+		dispatchers.emplace_back([&router] { for (int j = 0; j < 500; ++j) router.processIntent(LookupIntent{ j }); });
+	for (std::thread& dispatcher : dispatchers)
+		dispatcher.join();
+
+	const std::pair<int, std::thread::id>& first = plugins["First"];
+	check("handlers of a plugin run on its mailbox one at a time", isSingleThreaded && first.first == 2000 && first.second != std::this_thread::get_id());
+
+	bool hasThrown = false;
+	try
+	{
+		router.enableActorExecution();
+	}
+	catch (const std::logic_error&)
+	{
+		hasThrown = true;
+	}
+	check("actor execution can't be enabled after plugins register", hasThrown);
+
+	// a copy of an unregistered handler must not wait for a worker
+	// that is gone
+	pp::Mailbox mailbox;
+	const bool isCalled = mailbox.call([] { return 1; }) == 1;
+	mailbox.stop();
+	bool isRejected = false;
+	try
+	{
+		mailbox.call([] { return 1; });
+	}
+	catch (const std::runtime_error&)
+	{
+		isRejected = true;
+	}
+	check("stopped mailbox rejects calls and messages", isCalled && isRejected && !mailbox.post([] {}));
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class HoardIntent
+{
+public:
+	using Result = std::size_t;
+	static inline pp::IntentInfo Info = { "HoardIntent", 1 };
+
+	std::size_t size = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+// Keeps everything it's asked to allocate so the memory stays 
+// attributed to it.
+class HoardingPlugin : public pp::IPlugin
+{
+public:
+	void init(pp::Router& router) final
+	{
+		router.registerIntentHandler<HoardIntent>(getPluginInfo(), [this](HoardIntent intent)
+		{
+			m_blocks.push_back(std::make_unique<char[]>(intent.size));
+			return m_blocks.size();
+		});
+	}
+
+	void deinit(pp::Router& /*router*/) final { }
+	pp::PluginInfo getPluginInfo() const final { return { "Hoarding", { 1, 0, 0 } }; }
+
+	static pp::IPlugin* STDCALL create() { return new HoardingPlugin(); }
+
+private:
+	std::vector<std::unique_ptr<char[]>> m_blocks;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static const bool s_hoardingPluginRegistered = pp::StaticPluginsRegistry::add("HoardingPlugin", &HoardingPlugin::create);
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkMemoryAccountingAndEviction(const std::filesystem::path& pluginsPath)
+{
+	pp::PluginsContainer container;
+	container.getRouter()->enableUsageTracking();
+	container.loadStatic();
+	container.load(pluginsPath, false);
+
+	bool hasThrown = false;
+	try
+	{
+		container.getRouter()->enableUsageTracking();
+	}
+	catch (const std::logic_error&)
+	{
+		hasThrown = true;
+	}
+	check("usage tracking can't be enabled after plugins register", hasThrown);
+
+	constexpr std::size_t blockSize = std::size_t(1) << 20;
+	for (int i = 0; i < 4; ++i)
+		container.getRouter()->processIntent(HoardIntent{ blockSize });
+
+	const std::vector<pp::PluginMemoryReport> report = container.getMemoryReport();
+	const auto hoarding = std::find_if(report.begin(), report.end(), [](const pp::PluginMemoryReport& plugin) { return plugin.name == "Hoarding"; });
+	const bool isReported = s_hoardingPluginRegistered && hoarding != report.end() && hoarding->isLoaded;
+#if defined(PP_TEST_MEMORY_ACCOUNTING)
+	check("allocations of handlers are attributed to their plugin", isReported && 
+		hoarding->allocated.allocatedBytes >= 4 * blockSize && hoarding->allocated.allocatedBytes < 5 * blockSize && hoarding->allocated.allocationsCount >= 4);
+#else
+	check("plugin is in the memory report", isReported);
+	std::cout << "[SKIP] memory accounting, TestApp is built without it" << std::endl;
+#endif
+
+	if (!container.getRouter()->processIntent(AddIntent{ 2, 3 }))
+	{
+		std::cout << "[SKIP] eviction, no calculator plugin" << std::endl;
+		return;
+	}
+
+	pp::EvictionPolicy policy;
+	policy.memoryBudget = 1;
+	const std::size_t evictedCount = container.evictPlugins(policy);
+
+	// the lifetime plugins dispatch from deinit which loads the ones
+	// evicted before them again so only these two are checked
+	std::size_t unloadedCount = 0;
+	for (const pp::PluginMemoryReport& plugin : container.getMemoryReport())
+		if ((plugin.name == "Calculator" || plugin.name == "Hoarding") && !plugin.isLoaded)
+			++unloadedCount;
+	check("plugins over the memory budget are evicted", evictedCount >= 2 && unloadedCount == 2);
+
+	// a cached result would hide the reload
+	const std::optional<int> result = container.getRouter()->processIntent(AddIntent{ 4, 5 });
+	check("evicted plugin is reloaded on dispatch", result == 9 && container.getFailedReloads().empty());
+
+	const bool isHoardingReloaded = *container.getRouter()->processIntent(HoardIntent{ 16 }) == 1;
+	check("evicted plugin starts with fresh state", isHoardingReloaded);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class KeyEvent
+{
+public:
+	using Result = bool; // true if consumed
+	static inline pp::EventInfo Info = { "KeyEvent", 1 };
+	static bool stopsPropagation(bool consumed) { return consumed; }
+
+	int key = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkPriorityAndStopPropagation()
+{
+	pp::Router router(std::make_shared<pp::Selector>(), std::make_shared<pp::ThreadPool>(2));
+
+	// registered from the lowest priority, only the middle one consumes
+	std::vector<int> calls;
+	for (int priority = 0; priority < 3; ++priority)
+		router.registerEventReceiver<KeyEvent>({ "Widget" + std::to_string(priority), { 1, 0, 0 } }, [&calls, priority](const KeyEvent&)
+		{
+			calls.push_back(priority);
+			return priority == 1;
+		}, pp::ReceiverOrder{ {}, {}, priority });
+
+	const std::vector<std::optional<bool>> results = router.processEvent(KeyEvent{ 42 });
+	check("receivers with higher priority are called first", calls.size() >= 2 && calls[0] == 2 && calls[1] == 1);
+	check("consumed event doesn't reach the remaining receivers", calls.size() == 2 && results.size() == 3 && std::count(results.begin(), results.end(), std::nullopt) == 1);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class ImageLoadedEvent
+{
+public:
+	using Result = bool;
+	static inline pp::EventInfo Info = { "ImageLoadedEvent", 1 };
+
+	pp::Payload pixels;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkPayloads()
+{
+	pp::Router router;
+
+	std::vector<pp::Payload> retained;
+	std::size_t receivedBytes = 0;
+	router.registerEventReceiver<ImageLoadedEvent>({ "Thumbnails", { 1, 0, 0 } }, [&retained](const ImageLoadedEvent& event)
+	{
+		retained.push_back(event.pixels);
+		return true;
+	});
+	router.registerEventReceiver<ImageLoadedEvent>({ "Histogram", { 1, 0, 0 } }, [&receivedBytes](const ImageLoadedEvent& event)
+	{
+		receivedBytes += event.pixels.size();
+		return true;
+	});
+
+	pp::PayloadWriter writer = router.getPayloadPool().acquire(4096);
+	std::memset(writer.data(), 7, writer.size());
+	pp::Payload pixels = std::move(writer).freeze();
+	router.processEvent(ImageLoadedEvent{ pixels });
+	check("receivers share the payload and may retain it", receivedBytes == 4096 && pixels.getUseCount() == 2 && retained[0].data() == pixels.data());
+
+	pixels = pixels; // self-assignment keeps the reference
+	check("self-assigned payload keeps its reference", pixels.getUseCount() == 2 && pixels.data()[4095] == std::byte{ 7 });
+
+	retained.clear();
+	pixels = pp::Payload();
+	const pp::PayloadPoolStats released = router.getPayloadPool().getStats();
+	check("released payload goes back to the pool", released.liveBuffersCount == 0 && released.cachedBuffersCount == 1);
+
+	// rounded up to the same size class
+	const pp::PayloadWriter reused = router.getPayloadPool().acquire(4000);
+	check("cached buffer is reused", router.getPayloadPool().getStats().reusesCount == 1);
+
+	pp::PayloadPoolOptions options;
+	options.maxCachedBytes = 8192;
+	pp::PayloadPool smallPool(options);
+	std::vector<pp::Payload> payloads;
+	for (int i = 0; i < 4; ++i)
+		payloads.push_back(smallPool.acquire(4096).freeze());
+	payloads.clear();
+	check("cached bytes are capped", smallPool.getStats().cachedBytes <= 8192 && smallPool.getStats().cachedBuffersCount == 2);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+// Number of IPlugin::warmUp calls made to WarmingPlugin instances and
+// the result of the dispatch it makes from there.
+static int s_warmUpCallsCount = 0;
+static std::optional<int> s_warmUpResult;
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+// Dispatches to the calculator from its warm-up hook the way a plugin
+// would prime its dependencies.
+class WarmingPlugin : public pp::IPlugin
+{
+public:
+	void init(pp::Router& /*router*/) final { }
+	void deinit(pp::Router& /*router*/) final { }
+	pp::PluginInfo getPluginInfo() const final { return { "Warming", { 1, 0, 0 } }; }
+
+	void warmUp(pp::Router& router) final
+	{
+		++s_warmUpCallsCount;
+		s_warmUpResult = router.processIntent(AddIntent{ 1, 1 });
+	}
+
+	static pp::IPlugin* STDCALL create() { return new WarmingPlugin(); }
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static const bool s_warmingPluginRegistered = pp::StaticPluginsRegistry::add("WarmingPlugin", &WarmingPlugin::create);
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkWarmUp(const std::filesystem::path& pluginsPath)
+{
+	pp::PluginsContainer container;
+	container.getRouter()->setLatencyTracking(true);
+	container.load(pluginsPath, false);
+	container.loadStatic();
+
+	std::size_t loadedCount = 0;
+	for (const pp::PluginLoadReport& plugin : container.getStartupReport().plugins)
+		if (plugin.status == pp::ePluginLoadStatus::INITIALIZED)
+			++loadedCount;
+
+	s_warmUpCallsCount = 0;
+	const std::size_t warmedUpCount = container.warmUp(pp::WarmUpOptions{ true, false, true }); // prefault, lock, hook
+	check("all loaded plugins are warmed up", warmedUpCount > 0 && warmedUpCount == loadedCount);
+	check("warm-up hook is called once", s_warmingPluginRegistered && s_warmUpCallsCount == 1);
+	check("plugins loaded before aren't warmed up again", container.warmUp() == 0 && s_warmUpCallsCount == 1);
+
+	const std::vector<pp::PluginLoadReport>& plugins = container.getStartupReport().plugins;
+	const auto calculator = std::find_if(plugins.begin(), plugins.end(), [](const pp::PluginLoadReport& plugin) { return plugin.name == "Calculator"; });
+	if (calculator == plugins.end() || s_warmUpResult != 2)
+	{
+		std::cout << "[SKIP] prefault and latency report, no calculator plugin" << std::endl;
+		return;
+	}
+	check("library of the dynamic plugin is prefaulted", calculator->prefaultedSize > 0);
+
+	for (int i = 0; i < 3; ++i)
+		container.getRouter()->processIntent(AddIntent{ i, 10 });
+
+	const std::vector<pp::HandlerLatencyReport> latencies = container.getRouter()->getLatencyReport();
+	const auto addLatency = std::find_if(latencies.begin(), latencies.end(), [](const pp::HandlerLatencyReport& handler)
+	{
+		return handler.intentName == "AddIntent" && handler.pluginName == "Calculator";
+	});
+	check("latency report has first call and steady state of the handler", addLatency != latencies.end() && 
+		addLatency->callsCount == 4 && addLatency->firstCall.count() >= 0 && addLatency->steadyState.count() >= 0);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+class SessionIntent
+{
+public:
+	using Result = std::thread::id;
+	static inline pp::IntentInfo Info = { "SessionIntent", 1 };
+	static int partitionKey(const SessionIntent& intent) { return intent.sessionId; }
+
+	int sessionId = 0;
+	int sequence = 0;
+};
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+static void checkSharding()
+{
+	pp::Router router;
+
+	std::vector<std::map<int, int>> lastSequences(4);
+	bool isOrdered = true;
+	router.registerShardedIntentHandler<SessionIntent>({ "Sessions", { 1, 0, 0 } }, lastSequences.size(), [&](std::size_t shard)
+	{
+		return std::function<std::thread::id(SessionIntent)>([&isOrdered, &sequences = lastSequences[shard]](SessionIntent intent)
+		{
+			const auto last = sequences.find(intent.sessionId);
+			if (last != sequences.end() && last->second >= intent.sequence)
+				isOrdered = false;
+			sequences[intent.sessionId] = intent.sequence;
+			return std::this_thread::get_id();
+		});
+	});
+
+	std::map<int, std::thread::id> sessionThreads;
+	bool isPartitioned = true;
+	for (int sequence = 0; sequence < 100; ++sequence)
+		for (int session = 0; session < 16; ++session)
+		{
+			const std::thread::id threadId = *router.processIntent(SessionIntent{ session, sequence });
+			const auto [it, inserted] = sessionThreads.try_emplace(session, threadId);
+			isPartitioned = isPartitioned && it->second == threadId;
+		}
+
+	std::size_t usedShardsCount = 0;
+	for (const std::map<int, int>& sequences : lastSequences)
+		usedShardsCount += sequences.empty() ? 0 : 1;
+	check("intents of one session are processed by one shard in order", isPartitioned && isOrdered);
+	check("sessions are spread over the shards", usedShardsCount > 1);
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+int runFeatureChecks(const std::filesystem::path& pluginsPath)
+{
+	s_failedChecksCount = 0;
+
+	checkReceiversOrder();
+	checkStartupReport(pluginsPath);
+	checkCoalescing();
+	checkIntentCache();
+	checkHandleLifetimes();
+	checkDeadlineFallback();
+	checkStaticPlugins();
+	checkActorExecution();
+	checkMemoryAccountingAndEviction(pluginsPath);
+	checkPriorityAndStopPropagation();
+	checkPayloads();
+	checkWarmUp(pluginsPath);
+	checkSharding();
+
+	return s_failedChecksCount;
+}
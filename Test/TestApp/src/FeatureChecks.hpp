@@ -0,0 +1,11 @@
+#pragma once
+
+#include <filesystem>
+
+//------------------------------------------------------------------------------------------------------------------------------------------
+// Drives the features of PolyPlugin one by one and prints the result
+// of every check.
+// @returns number of failed checks
+// @param pluginsPath - directory with the test plugins, used by the
+//		checks that load them
+int runFeatureChecks(const std::filesystem::path& pluginsPath);
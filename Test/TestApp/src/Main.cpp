@@ -3,6 +3,11 @@
 #include <pp/PolyPlugin.hpp>
 #include <pp/Defines.hpp>
 #include <AddIntent.hpp>
+#include <FeatureChecks.hpp>
+
+#if defined(PP_TEST_MEMORY_ACCOUNTING)
+	POLY_PLUGIN_MEMORY_ACCOUNTING()
+#endif
 
 //------------------------------------------------------------------------------------------------------------------------------------------
 int main()
@@ -11,6 +16,7 @@ int main()
 
 	std::cout << "Current path: " << std::filesystem::current_path() << std::endl;
 	container.load(std::filesystem::current_path(), false);
+	container.loadStatic();
     
 	AddIntent intent{ 2, 3 };
 	std::optional<AddIntent::Result> result = container.getRouter()->processIntent(std::move(intent));
@@ -21,5 +27,8 @@ int main()
 
     std::cout << std::endl << std::endl;
 
-    return 0;
+	const int failedChecksCount = runFeatureChecks(std::filesystem::current_path());
+	std::cout << std::endl << "Failed checks: " << failedChecksCount << std::endl;
+
+    return failedChecksCount == 0 ? 0 : 1;
 }
\ No newline at end of file